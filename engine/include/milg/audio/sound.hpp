@@ -1,18 +1,45 @@
 #pragma once
 
 #include <milg/audio/node.hpp>
+#include <milg/core/asset.hpp>
 #include <milg/core/types.hpp>
 
+#include <memory>
 #include <miniaudio.h>
 
 namespace milg::audio {
+    // PCM frames decoded in the engine's format, owned by every Sound created from them
+    struct SoundData {
+        SoundData()                  = default;
+        SoundData(const SoundData &) = delete;
+        SoundData(SoundData &&)      = delete;
+
+        SoundData &operator=(const SoundData &) = delete;
+        SoundData &operator=(SoundData &&)      = delete;
+
+        ~SoundData();
+
+        ma_uint32 channels    = 0;
+        ma_uint64 frame_count = 0;
+        void     *frames      = nullptr;
+    };
+
     class Sound : public Node {
     public:
+        class Loader : public Asset::Loader {
+        public:
+            auto decode(ByteView data) -> LoadResult<void> override;
+            auto finalize(const std::shared_ptr<void> &decoded) -> LoadResult<void> override;
+            bool finalize_on_main_thread() const override;
+            auto measure(const std::shared_ptr<void> &asset) const -> AssetMemory override;
+        };
+
         Sound()              = delete;
         Sound(const Sound &) = delete;
         Sound(Sound &&)      = default;
 
         Sound(const std::shared_ptr<Bytes> &bytes);
+        Sound(const std::shared_ptr<SoundData> &data);
 
         ~Sound();
 
@@ -26,8 +53,13 @@ namespace milg::audio {
         float get_volume();
         void  set_volume(float volume);
 
+        const std::shared_ptr<SoundData> &get_data() const;
+
+        static std::shared_ptr<SoundData> decode(ByteView bytes);
+
     private:
-        ma_audio_buffer buffer;
-        ma_sound        sound;
+        std::shared_ptr<SoundData> data;
+        ma_audio_buffer            buffer;
+        ma_sound                   sound;
     };
 } // namespace milg::audio
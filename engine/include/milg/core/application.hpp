@@ -1,19 +1,25 @@
 #pragma once
 
 #include <milg/core/imgui_layer.hpp>
+#include <milg/core/jobs.hpp>
 #include <milg/core/window.hpp>
+#include <milg/graphics/command_buffer_pool.hpp>
 #include <milg/graphics/swapchain.hpp>
 #include <milg/graphics/vk_context.hpp>
 
 #include <array>
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <vector>
 
 namespace milg {
     class Application {
     public:
-        Application(int argc, char **argv, const WindowCreateInfo &window_create_info);
+        Application(int argc, char **argv, const WindowCreateInfo &window_create_info, uint32_t frames_in_flight = 2);
         virtual ~Application();
 
         int  run(float min_frametime = 0.0f);
@@ -26,12 +32,32 @@ namespace milg {
         const std::unique_ptr<Window>                  &window() const;
         const std::shared_ptr<graphics::VulkanContext> &context() const;
         const std::shared_ptr<graphics::Swapchain>     &swapchain() const;
+        // Timeline the device signals with a frame's value once it finished the frame, values increase by one per
+        // frame so waiting on frame_value() of an earlier frame covers everything recorded during it
+        VkSemaphore frame_semaphore() const;
+        uint64_t    frame_value() const;
+        bool        is_frame_complete(uint64_t value) const;
+        void        wait_for_frame(uint64_t value) const;
+
+        // Shared by the engine's services and the layers, one worker per core besides the main thread
+        jobs::Scheduler &scheduler() const;
 
         bool is_key_down(int32_t scan_code) const;
         bool is_mouse_button_down(int32_t button) const;
 
         VkCommandBuffer acquire_command_buffer();
 
+        // Records on a worker thread into a command buffer from a pool only that recording uses. The buffer is begun
+        // and ended around the recorder and submitted with the acquired ones in the order they were requested. The
+        // recorder must not touch state the calling thread keeps using during the frame
+        void record_command_buffer(std::function<void(VkCommandBuffer)> recorder);
+
+        // Applied before the next frame starts, falls back towards FIFO when the surface doesn't support the mode
+        void set_present_mode(PresentMode present_mode);
+        // Trades throughput for input latency, see WindowCreateInfo::low_latency
+        void set_low_latency(bool low_latency);
+        bool low_latency() const;
+
         uint32_t frames_per_second() const;
 
     private:
@@ -46,24 +72,33 @@ namespace milg {
         std::shared_ptr<ImGuiLayer>              m_imgui_layer = nullptr;
         std::vector<Layer *>                     m_layers      = {};
         bool                                     m_running     = true;
+        bool                                     m_low_latency = false;
+        std::unique_ptr<jobs::Scheduler>         m_scheduler   = nullptr;
+
+        std::optional<PresentMode> m_pending_present_mode = std::nullopt;
 
         uint32_t m_frames_per_second = 0;
 
         struct {
-            const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
-
-            std::vector<VkFence>     fences;
+            VkSemaphore              frame_semaphore = VK_NULL_HANDLE;
+            uint64_t                 frame_value     = 0;
+            std::vector<uint64_t>    frame_values;
             std::vector<VkSemaphore> image_available_semaphores;
-            std::vector<VkSemaphore> image_ready_semaphores;
-            std::vector<VkSemaphore> layer_render_finished_semaphores;
             std::vector<VkSemaphore> render_finished_semaphores;
 
-            VkCommandPool                             command_pool = VK_NULL_HANDLE;
-            std::vector<std::vector<VkCommandBuffer>> leased_command_buffers;
-            std::vector<VkCommandBuffer>              pre_frame_command_buffers;
-            std::vector<VkCommandBuffer>              post_frame_command_buffers;
+            // One pool per frame slot, reset as a whole once the slot's previous frame finished
+            std::vector<std::unique_ptr<graphics::CommandBufferPool>> command_pools;
+            std::vector<std::deque<VkCommandBuffer>>                  leased_command_buffers;
+            std::vector<VkCommandBuffer>                              pre_frame_command_buffers;
+            std::vector<VkCommandBuffer>                              post_frame_command_buffers;
+
+            // Pools for recordings on worker threads, a recording takes an idle pool of its frame slot and returns
+            // it once done, so no pool is ever used by two threads at once
+            std::vector<std::vector<std::unique_ptr<graphics::CommandBufferPool>>> worker_pools;
+            std::vector<std::vector<graphics::CommandBufferPool *>>                idle_worker_pools;
+            jobs::Counter                                                          recordings;
+            std::mutex                                                             recording_mutex;
 
-            uint32_t last_frame    = MAX_FRAMES_IN_FLIGHT - 1;
             uint32_t current_frame = 0;
         } m_frame_resources;
         void init_frame_resources();
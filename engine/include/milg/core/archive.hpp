@@ -0,0 +1,35 @@
+#pragma once
+
+#include <milg/core/archive_format.hpp>
+#include <milg/core/asset_id.hpp>
+#include <milg/core/mapped_file.hpp>
+#include <milg/core/types.hpp>
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+
+namespace milg {
+    // Packed asset archive, the whole file stays mapped and entries are served from the in-memory index
+    class Archive {
+    public:
+        static std::shared_ptr<Archive> create(const std::filesystem::path &path);
+
+        bool contains(AssetId id) const;
+        // Uncompressed entries are returned as a view into the mapping, compressed ones are decompressed into buffer
+        auto read(AssetId id, Bytes &buffer) const -> std::optional<ByteView>;
+
+        const std::filesystem::path &path() const;
+
+    private:
+        Archive() = default;
+
+        std::filesystem::path         m_path    = {};
+        std::unique_ptr<MappedFile>   m_file    = nullptr;
+        std::span<const ArchiveEntry> m_entries = {};
+        const char                   *m_paths   = nullptr;
+
+        const ArchiveEntry *find(AssetId id) const;
+    };
+} // namespace milg
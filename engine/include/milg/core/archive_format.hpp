@@ -0,0 +1,40 @@
+#pragma once
+
+#include <milg/core/asset_id.hpp>
+
+#include <cstdint>
+
+// On-disk layout of asset archives, shared between the engine and the asset packer
+//
+// [ArchiveHeader][entry data, each aligned to ARCHIVE_ALIGNMENT][ArchiveEntry * entry_count][path strings]
+//
+// Entries are sorted by their hash_asset_path() so lookups are a binary search, paths are stored to resolve hash
+// collisions
+namespace milg {
+    constexpr char     ARCHIVE_MAGIC[8]  = {'M', 'I', 'L', 'G', 'P', 'A', 'K', '\0'};
+    constexpr uint32_t ARCHIVE_VERSION   = 1;
+    constexpr uint64_t ARCHIVE_ALIGNMENT = 16;
+
+    enum class ArchiveCompression : uint32_t {
+        NONE = 0,
+        LZ4  = 1,
+    };
+
+    struct ArchiveHeader {
+        char     magic[8]     = {};
+        uint32_t version      = 0;
+        uint32_t entry_count  = 0;
+        uint64_t index_offset = 0;
+        uint64_t paths_offset = 0;
+    };
+
+    struct ArchiveEntry {
+        uint64_t           hash              = 0;
+        uint64_t           offset            = 0;
+        uint64_t           size              = 0;
+        uint64_t           uncompressed_size = 0;
+        uint64_t           path_offset       = 0;
+        uint32_t           path_length       = 0;
+        ArchiveCompression compression       = ArchiveCompression::NONE;
+    };
+} // namespace milg
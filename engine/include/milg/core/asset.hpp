@@ -1,88 +1,236 @@
 #pragma once
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <expected>
 #include <filesystem>
-#include <fstream>
+#include <map>
 #include <memory>
+#include <milg/core/archive.hpp>
+#include <milg/core/asset_id.hpp>
 #include <milg/core/error.hpp>
+#include <milg/core/file_watcher.hpp>
+#include <milg/core/id_map.hpp>
+#include <milg/core/jobs.hpp>
 #include <milg/core/logging.hpp>
 #include <milg/core/types.hpp>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <typeindex>
+#include <vector>
 
 namespace milg {
     template <typename T> using LoadResult = std::expected<std::shared_ptr<T>, asset_load_error>;
 
+    // Memory held by an asset, or the budget the asset cache may keep resident
+    struct AssetMemory {
+        size_t cpu = 0;
+        size_t gpu = 0;
+    };
+
     class Asset {
     public:
         class Loader {
         public:
-            virtual auto load(std::ifstream &stream) -> LoadResult<void>;
+            virtual ~Loader() = default;
+
+            // Decodes and finalizes the asset on the calling thread
+            auto load(ByteView data) -> LoadResult<void>;
+
+            // Paths tried in order for a requested asset, lets loaders prefer a precompiled variant of the file
+            virtual auto candidates(const std::filesystem::path &path) const -> std::vector<std::filesystem::path>;
+            // CPU side of loading (file parsing, image/audio decoding), may run on a worker thread. The data is a view
+            // of the mapped file and is only valid for the duration of the call
+            virtual auto decode(ByteView data) -> LoadResult<void>;
+            // Turns the decoded data into the final asset, runs on the main thread if finalize_on_main_thread()
+            virtual auto finalize(const std::shared_ptr<void> &decoded) -> LoadResult<void>;
+            virtual bool finalize_on_main_thread() const;
+            // Memory owned by a finalized asset, the size of the source file is used when this reports nothing
+            virtual auto measure(const std::shared_ptr<void> &asset) const -> AssetMemory;
+            // Moves a hot reloaded asset into the one already handed out, so existing handles see the new contents.
+            // Runs on the main thread, returning false replaces the cached asset instead and leaves old handles as-is
+            virtual bool reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh);
 
         protected:
             const std::filesystem::path &get_current_path();
-            Bytes                        read_stream(std::ifstream &stream);
 
         private:
             friend class AssetStore;
 
             void set_current_path(const std::filesystem::path &path);
 
-            std::filesystem::path path;
+            // Loaders are shared between worker threads, so the path of the asset being loaded is per thread
+            static thread_local std::filesystem::path path;
+        };
+
+        class BytesLoader : public Loader {
+        public:
+            bool reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh) override;
         };
 
         class JsonLoader : public Loader {
         public:
-            auto load(std::ifstream &stream) -> LoadResult<void> override;
+            auto decode(ByteView data) -> LoadResult<void> override;
+            bool reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh) override;
         };
     };
 
-    class AssetStore {
+    class AssetRequest : public std::enable_shared_from_this<AssetRequest> {
     public:
-        static void add_search_path(const std::filesystem::path &path);
+        bool is_ready() const;
+        auto wait() -> LoadResult<void>;
 
-        template <typename T> static auto load(const std::filesystem::path &path) -> LoadResult<T> {
-            if (auto iter = AssetStore::assets.find(path); iter != AssetStore::assets.end()) {
-                return std::static_pointer_cast<T>(iter->second);
-            }
+    private:
+        friend class AssetStore;
 
-            std::shared_ptr<Asset::Loader> loader = nullptr;
+        enum class State {
+            QUEUED,
+            DECODING,
+            DECODED,
+            DONE,
+        };
 
-            if (auto iter = AssetStore::loaders.find(std::type_index(typeid(T))); iter != loaders.end()) {
-                loader = iter->second;
-            } else {
-                return std::unexpected(asset_load_error::invalid_type);
-            }
+        AssetId                        id;
+        std::filesystem::path          path;
+        std::type_index                type = std::type_index(typeid(void));
+        std::shared_ptr<Asset::Loader> loader;
+        std::filesystem::path          resolved_path;
+        size_t                         file_size = 0;
+        bool                           on_disk   = false;
+        bool                           reload    = false;
+
+        std::shared_ptr<void>           decoded   = nullptr;
+        std::optional<LoadResult<void>> result    = std::nullopt;
+        std::exception_ptr              exception = nullptr;
+        State                           state     = State::QUEUED;
+
+        mutable std::mutex      mutex;
+        std::condition_variable condition;
+    };
 
-            MILG_DEBUG("Loading {}…", path.string());
+    template <typename T> class AssetFuture {
+    public:
+        AssetFuture() = default;
+        AssetFuture(const std::shared_ptr<AssetRequest> &request) : request(request) {
+        }
 
-            for (const auto &search_path : AssetStore::search_paths) {
-                auto          current_path = search_path / path;
-                std::ifstream stream(current_path, std::ios::binary | std::ios::in);
-                if (!stream.is_open()) {
-                    continue;
-                }
+        bool valid() const {
+            return request != nullptr;
+        }
 
-                loader->set_current_path(current_path);
+        bool is_ready() const {
+            return request != nullptr && request->is_ready();
+        }
 
-                if (auto result = loader->load(stream); result.has_value()) {
-                    assets.insert({path, *result});
+        auto get() const -> LoadResult<T> {
+            assert(request != nullptr);
 
-                    return std::static_pointer_cast<T>(*result);
-                }
+            auto result = request->wait();
+            if (!result.has_value()) {
+                return std::unexpected(result.error());
             }
 
-            return std::unexpected(asset_load_error::file_not_found);
+            return std::static_pointer_cast<T>(*result);
         }
+
+    private:
+        std::shared_ptr<AssetRequest> request = nullptr;
+    };
+
+    class AssetStore {
+    public:
+        static void add_search_path(const std::filesystem::path &path);
+        // Archives are searched before the search paths, in the order they were added
+        static bool add_archive(const std::filesystem::path &path);
+
+        template <typename T> static auto load(AssetId id) -> LoadResult<T> {
+            if (auto asset = AssetStore::get<T>(id); asset != nullptr) {
+                return asset;
+            }
+
+            return AssetFuture<T>(AssetStore::request(id, std::type_index(typeid(T)), false)).get();
+        }
+
+        // Decodes the asset on a worker thread, requests for a path that is already in flight share the same future.
+        // Loaders that finalize on the main thread complete either in update() or when the future is waited on
+        template <typename T> static auto load_async(AssetId id) -> AssetFuture<T> {
+            return AssetFuture<T>(AssetStore::request(id, std::type_index(typeid(T)), true));
+        }
+
+        // Returns the asset if it's already loaded, without starting a load
+        template <typename T> static auto get(AssetId id) -> std::shared_ptr<T> {
+            return std::static_pointer_cast<T>(AssetStore::find(id));
+        }
+
+        // Finalizes decoded assets that need the main thread and evicts over budget, called once per frame by the
+        // application
+        static void update();
         static void unload_all();
 
+        // Decodes run on the given scheduler, without one the store starts its own on the first asynchronous load
+        static void set_scheduler(jobs::Scheduler *scheduler);
+
+        // Once the resident assets exceed the budget the least recently used ones are evicted, assets that are still
+        // referenced elsewhere are only downgraded to weak entries and reused if requested again while alive
+        static void set_memory_budget(const AssetMemory &budget);
+        static auto memory_usage() -> std::map<std::type_index, AssetMemory>;
+
+        // Watches the files of assets loaded from the search paths afterwards and reloads them in update() when they
+        // change on disk. Assets served from archives are never watched
+        static void enable_hot_reload();
+        // Bumped every time the asset is hot reloaded, lets users rebuild state derived from the asset's contents
+        static uint64_t version(AssetId id);
+
         template <typename T> static void register_loader(std::shared_ptr<Asset::Loader> loader) {
+            std::lock_guard lock(AssetStore::mutex);
             AssetStore::loaders[std::type_index(typeid(T))] = loader;
         }
 
     private:
+        friend class AssetRequest;
+
+        struct CachedAsset {
+            AssetId               id        = {};
+            std::shared_ptr<void> strong    = nullptr;
+            std::weak_ptr<void>   weak      = {};
+            std::type_index       type      = std::type_index(typeid(void));
+            AssetMemory           memory    = {};
+            uint64_t              last_used = 0;
+        };
+
         static std::vector<std::filesystem::path>                        search_paths;
+        static std::vector<std::shared_ptr<Archive>>                     archives;
         static std::map<std::type_index, std::shared_ptr<Asset::Loader>> loaders;
-        static std::map<std::filesystem::path, std::shared_ptr<void>>    assets;
+        static IdMap<CachedAsset>                                        assets;
+        static IdMap<std::shared_ptr<AssetRequest>>                      in_flight;
+        static std::deque<std::shared_ptr<AssetRequest>>                 finalize_queue;
+        static AssetMemory                                               budget;
+        static uint64_t                                                  access_counter;
+        static std::mutex                                                mutex;
+        static std::thread::id                                           main_thread_id;
+        static std::unique_ptr<FileWatcher>                              watcher;
+        static IdMap<AssetId>                                            watched_files;
+        static IdMap<uint64_t>                                           versions;
+        static jobs::Counter                                             decode_jobs;
+        static jobs::Scheduler                                          *scheduler;
+        static std::unique_ptr<jobs::Scheduler>                          owned_scheduler;
+
+        static auto find(AssetId id) -> std::shared_ptr<void>;
+        // Same as find(), for callers already holding the mutex
+        static auto find_resident(AssetId id) -> std::shared_ptr<void>;
+        static auto request(AssetId id, std::type_index type, bool async) -> std::shared_ptr<AssetRequest>;
+        static void reload(AssetId id, std::type_index type);
+        // Queues the request's decode on the scheduler, expects the mutex held
+        static void submit(const std::shared_ptr<AssetRequest> &request);
+        static void decode(const std::shared_ptr<AssetRequest> &request);
+        static void finalize(const std::shared_ptr<AssetRequest> &request);
+        static void complete(const std::shared_ptr<AssetRequest> &request, LoadResult<void> result,
+                             std::exception_ptr exception);
+        static void evict();
     };
 } // namespace milg
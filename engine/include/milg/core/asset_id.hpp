@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+namespace milg {
+    // FNV-1a over the normalized, '/' separated path
+    constexpr uint64_t hash_asset_path(std::string_view path) {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (char c : path) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x100000001B3ull;
+        }
+
+        return hash;
+    }
+
+    // Interned asset path, cheap to copy and compare. String literals are hashed at compile time and have to be in
+    // normalized form already, other paths are normalized and interned once when the id is created
+    class AssetId {
+    public:
+        AssetId() = default;
+
+        template <size_t N> consteval AssetId(const char (&path)[N]) : AssetId(std::string_view(path, N - 1)) {
+        }
+
+        // Throws if the path hashes the same as a different path interned before
+        AssetId(const std::filesystem::path &path);
+
+        consteval static AssetId from_literal(std::string_view path) {
+            return AssetId(path);
+        }
+
+        constexpr uint64_t hash() const {
+            return m_hash;
+        }
+
+        constexpr std::string_view path() const {
+            return m_path;
+        }
+
+        constexpr bool operator==(const AssetId &other) const {
+            return m_hash == other.m_hash;
+        }
+
+        // Literals are hashed at compile time and only checked against the paths interned at runtime once this is
+        // called, which AssetStore does for every id it is handed. Throws on a collision like the path constructor
+        void intern() const;
+
+    private:
+        uint64_t         m_hash    = 0;
+        std::string_view m_path    = {};
+        bool             m_literal = false;
+
+        consteval explicit AssetId(std::string_view path)
+            : m_hash(hash_asset_path(path)), m_path(path), m_literal(true) {
+            // Catches literals that wouldn't hash the same as their normalized runtime counterpart
+            if (path.empty() || path.starts_with("./") || path.starts_with("../") || path.ends_with("/") ||
+                path.find('\\') != std::string_view::npos || path.find("//") != std::string_view::npos ||
+                path.find("/./") != std::string_view::npos || path.find("/../") != std::string_view::npos) {
+                throw "Asset path literals have to be normalized";
+            }
+        }
+    };
+
+    inline namespace literals {
+        consteval AssetId operator""_asset(const char *path, size_t length) {
+            return AssetId::from_literal(std::string_view(path, length));
+        }
+    } // namespace literals
+} // namespace milg
@@ -8,6 +8,8 @@ namespace milg {
     enum class asset_load_error {
         invalid_type,
         file_not_found,
+        // A file was found but no loader could turn it into an asset
+        load_failed,
     };
 
     class vulkan_context_error {
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace milg {
+    // Reports files that were rewritten since the last poll. Directories are watched rather than the files themselves,
+    // editors commonly save by writing a new file and renaming it over the old one
+    class FileWatcher {
+    public:
+        // Returns nullptr on platforms without file change notifications
+        static std::unique_ptr<FileWatcher> create();
+
+        FileWatcher(const FileWatcher &) = delete;
+        FileWatcher(FileWatcher &&)      = delete;
+
+        FileWatcher &operator=(const FileWatcher &) = delete;
+        FileWatcher &operator=(FileWatcher &&)      = delete;
+
+        ~FileWatcher();
+
+        void watch(const std::filesystem::path &path);
+        // Never blocks, every changed path is reported once per poll in absolute, normalized form
+        auto poll() -> std::vector<std::filesystem::path>;
+
+    private:
+        FileWatcher() = default;
+
+        int                                  m_fd          = -1;
+        std::map<int, std::filesystem::path> m_directories = {};
+    };
+} // namespace milg
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace milg {
+    // Open addressing hash table keyed by precomputed 64-bit hashes (asset ids), with linear probing. Values are
+    // default constructed in empty slots, so pointers returned by find() stay valid until the next insertion
+    template <typename T> class IdMap {
+    public:
+        T *find(uint64_t key) {
+            const size_t index = this->find_slot(key);
+            return index == NOT_FOUND ? nullptr : &m_slots[index].value;
+        }
+
+        const T *find(uint64_t key) const {
+            const size_t index = this->find_slot(key);
+            return index == NOT_FOUND ? nullptr : &m_slots[index].value;
+        }
+
+        bool contains(uint64_t key) const {
+            return this->find_slot(key) != NOT_FOUND;
+        }
+
+        // Inserts a default constructed value if the key is not present yet
+        T &operator[](uint64_t key) {
+            if (const size_t index = this->find_slot(key); index != NOT_FOUND) {
+                return m_slots[index].value;
+            }
+
+            // Tombstones count towards the load factor, they are only dropped by rehashing
+            if ((m_size + m_tombstones + 1) * 4 > m_slots.size() * 3) {
+                this->rehash(std::max<size_t>(16, std::bit_ceil((m_size + 1) * 2)));
+            }
+
+            const size_t mask  = m_slots.size() - 1;
+            size_t       index = key & mask;
+            while (m_slots[index].state == SlotState::OCCUPIED) {
+                index = (index + 1) & mask;
+            }
+
+            if (m_slots[index].state == SlotState::DELETED) {
+                m_tombstones--;
+            }
+
+            m_slots[index].key   = key;
+            m_slots[index].state = SlotState::OCCUPIED;
+            m_size++;
+
+            return m_slots[index].value;
+        }
+
+        bool erase(uint64_t key) {
+            const size_t index = this->find_slot(key);
+            if (index == NOT_FOUND) {
+                return false;
+            }
+
+            m_slots[index].value = T{};
+            m_slots[index].state = SlotState::DELETED;
+            m_size--;
+            m_tombstones++;
+
+            return true;
+        }
+
+        template <typename Predicate> void erase_if(Predicate predicate) {
+            for (auto &slot : m_slots) {
+                if (slot.state == SlotState::OCCUPIED && predicate(slot.key, slot.value)) {
+                    slot.value = T{};
+                    slot.state = SlotState::DELETED;
+                    m_size--;
+                    m_tombstones++;
+                }
+            }
+        }
+
+        template <typename Function> void for_each(Function function) {
+            for (auto &slot : m_slots) {
+                if (slot.state == SlotState::OCCUPIED) {
+                    function(slot.key, slot.value);
+                }
+            }
+        }
+
+        template <typename Function> void for_each(Function function) const {
+            for (const auto &slot : m_slots) {
+                if (slot.state == SlotState::OCCUPIED) {
+                    function(slot.key, slot.value);
+                }
+            }
+        }
+
+        void clear() {
+            m_slots.clear();
+            m_size       = 0;
+            m_tombstones = 0;
+        }
+
+        size_t size() const {
+            return m_size;
+        }
+
+        bool empty() const {
+            return m_size == 0;
+        }
+
+    private:
+        enum class SlotState : uint8_t {
+            EMPTY,
+            OCCUPIED,
+            DELETED,
+        };
+
+        struct Slot {
+            uint64_t  key   = 0;
+            SlotState state = SlotState::EMPTY;
+            T         value = {};
+        };
+
+        static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+        std::vector<Slot> m_slots      = {};
+        size_t            m_size       = 0;
+        size_t            m_tombstones = 0;
+
+        size_t find_slot(uint64_t key) const {
+            if (m_slots.empty()) {
+                return NOT_FOUND;
+            }
+
+            // The load factor guarantees an empty slot, so the probe always terminates
+            const size_t mask  = m_slots.size() - 1;
+            size_t       index = key & mask;
+            while (m_slots[index].state != SlotState::EMPTY) {
+                if (m_slots[index].state == SlotState::OCCUPIED && m_slots[index].key == key) {
+                    return index;
+                }
+                index = (index + 1) & mask;
+            }
+
+            return NOT_FOUND;
+        }
+
+        void rehash(size_t capacity) {
+            auto slots   = std::exchange(m_slots, std::vector<Slot>(capacity));
+            m_size       = 0;
+            m_tombstones = 0;
+
+            for (auto &slot : slots) {
+                if (slot.state == SlotState::OCCUPIED) {
+                    (*this)[slot.key] = std::move(slot.value);
+                }
+            }
+        }
+    };
+} // namespace milg
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace milg::jobs {
+    using Job = std::function<void()>;
+
+    // Number of jobs still outstanding. Jobs submitted after a counter only run once it reaches zero, which is how
+    // dependencies are expressed. A counter must outlive the jobs it counts. The first exception thrown by one of
+    // its jobs is kept and rethrown by Scheduler::wait()
+    class Counter {
+    public:
+        Counter()                = default;
+        Counter(const Counter &) = delete;
+        Counter(Counter &&)      = delete;
+
+        Counter &operator=(const Counter &) = delete;
+        Counter &operator=(Counter &&)      = delete;
+
+        ~Counter() = default;
+
+        bool is_done();
+
+    private:
+        friend class Scheduler;
+
+        std::mutex         m_mutex;
+        uint32_t           m_count         = 0;
+        std::vector<Job>   m_continuations = {};
+        std::exception_ptr m_exception     = nullptr;
+    };
+
+    // Work stealing scheduler, every worker owns a deque it pushes to and pops from the back of while idle workers
+    // steal from the front of the others. Threads that aren't workers push to a shared deque instead
+    class Scheduler {
+    public:
+        // A thread count of 0 sizes the scheduler to the hardware concurrency minus the calling thread
+        Scheduler(uint32_t thread_count = 0);
+        Scheduler(const Scheduler &) = delete;
+        Scheduler(Scheduler &&)      = delete;
+
+        Scheduler &operator=(const Scheduler &) = delete;
+        Scheduler &operator=(Scheduler &&)      = delete;
+
+        // Jobs still queued, and the ones they queue, run before the scheduler is gone so their counters reach zero
+        ~Scheduler();
+
+        void submit(Job job, Counter *counter = nullptr);
+        // Queues the job once every job counted by dependency finished
+        void submit_after(Counter &dependency, Job job, Counter *counter = nullptr);
+        // Runs queued jobs on the calling thread until the counter reaches zero, so waiting inside a job can't
+        // starve the workers. Sleeps while there is nothing to run, and rethrows the exception of a failed job
+        void wait(Counter &counter);
+
+        // Calls function(begin, end) over chunks of at most grain_size indices and waits for all of them
+        template <typename Function>
+        void parallel_for(size_t begin, size_t end, size_t grain_size, Function &&function) {
+            Counter counter;
+            grain_size = std::max<size_t>(grain_size, 1);
+
+            for (size_t chunk_begin = begin; chunk_begin < end; chunk_begin += grain_size) {
+                const size_t chunk_end = std::min(chunk_begin + grain_size, end);
+                submit(
+                    [&function, chunk_begin, chunk_end] {
+                        function(chunk_begin, chunk_end);
+                    },
+                    &counter);
+            }
+
+            wait(counter);
+        }
+
+        uint32_t thread_count() const;
+
+    private:
+        struct Queue {
+            std::mutex      mutex;
+            std::deque<Job> jobs;
+        };
+
+        // One queue per worker, followed by the shared one for other threads
+        std::vector<std::unique_ptr<Queue>> m_queues;
+        std::vector<std::jthread>           m_threads;
+
+        std::atomic<uint32_t>       m_queued = 0;
+        std::mutex                  m_sleep_mutex;
+        std::condition_variable_any m_sleep_condition;
+
+        void push(Job job);
+        bool try_pop(Job &job);
+        void run(Job &job, Counter *counter);
+        void finish(Counter *counter);
+
+        void worker(std::stop_token stop_token, uint32_t index);
+    };
+} // namespace milg::jobs
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <milg/core/types.hpp>
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+
+namespace milg {
+    // Read-only view of a whole file, memory mapped where the platform allows it and read into memory otherwise
+    class MappedFile {
+    public:
+        static std::unique_ptr<MappedFile> create(const std::filesystem::path &path);
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile(MappedFile &&)      = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+        MappedFile &operator=(MappedFile &&)      = delete;
+
+        ~MappedFile();
+
+        ByteView bytes() const;
+        size_t   size() const;
+
+    private:
+        MappedFile() = default;
+
+        const std::byte *m_data   = nullptr;
+        size_t           m_size   = 0;
+        bool             m_mapped = false;
+        Bytes            m_buffer = {};
+    };
+} // namespace milg
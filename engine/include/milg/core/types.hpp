@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstddef>
+#include <span>
 #include <vector>
 
-typedef std::vector<std::byte> Bytes;
+typedef std::vector<std::byte>     Bytes;
+typedef std::span<const std::byte> ByteView;
@@ -12,11 +12,24 @@ namespace milg::graphics {
 }
 
 namespace milg {
+    // Preferred way of presenting frames, modes the surface doesn't support fall back towards FIFO
+    enum class PresentMode {
+        // Waits for vertical blank, always supported
+        FIFO,
+        // Replaces the queued frame with newer ones without tearing
+        MAILBOX,
+        // Presents right away and may tear
+        IMMEDIATE,
+    };
+
     struct WindowCreateInfo {
-        std::string title     = "Untitled";
-        int         width     = 800;
-        int         height    = 600;
-        bool        resizable = false;
+        std::string title        = "Untitled";
+        int         width        = 800;
+        int         height       = 600;
+        bool        resizable    = false;
+        PresentMode present_mode = PresentMode::FIFO;
+        // Waits for the previous frame to reach the screen before input is sampled, trades throughput for latency
+        bool        low_latency  = false;
     };
 
     class Window {
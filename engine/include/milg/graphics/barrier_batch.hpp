@@ -0,0 +1,28 @@
+#pragma once
+
+#include <milg/graphics/vk_context.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace milg::graphics {
+    // Collects image barriers and records them with one vkCmdPipelineBarrier2. Stage and access masks follow from the
+    // layouts, so a transition only waits for and flushes what the old layout can have been used for
+    class BarrierBatch {
+    public:
+        // Transitions that keep an image in a read only layout are skipped, a second transition of an image already in
+        // the batch is folded into the first one
+        void transition(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels = 1);
+        // Barriers with their masks already worked out, e.g. by the render graph
+        void add(const VkImageMemoryBarrier2 &barrier);
+
+        // Records the collected barriers, if any, and empties the batch
+        void flush(const VulkanContext &context, VkCommandBuffer command_buffer);
+
+        bool     empty() const;
+        uint32_t size() const;
+
+    private:
+        std::vector<VkImageMemoryBarrier2> m_barriers = {};
+    };
+} // namespace milg::graphics
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <milg/graphics/descriptor_heap.hpp>
 #include <milg/graphics/vk_context.hpp>
 
 #include <memory>
@@ -24,15 +25,19 @@ namespace milg::graphics {
         VmaAllocation      allocation() const;
         VmaAllocationInfo  allocation_info() const;
         VkBufferUsageFlags usage_flags() const;
+        // Slot of the whole buffer in the context's descriptor heap, INVALID_INDEX for buffers created without
+        // VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+        uint32_t descriptor_index() const;
 
     private:
         std::shared_ptr<VulkanContext> m_context = nullptr;
 
-        VkDeviceSize       m_size            = 0;
-        VkBuffer           m_handle          = VK_NULL_HANDLE;
-        VkBufferUsageFlags m_usage_flags     = 0;
-        VmaAllocation      m_allocation      = VK_NULL_HANDLE;
-        VmaAllocationInfo  m_allocation_info = {};
+        VkDeviceSize       m_size             = 0;
+        VkBuffer           m_handle           = VK_NULL_HANDLE;
+        VkBufferUsageFlags m_usage_flags      = 0;
+        VmaAllocation      m_allocation       = VK_NULL_HANDLE;
+        VmaAllocationInfo  m_allocation_info  = {};
+        uint32_t           m_descriptor_index = DescriptorHeap::INVALID_INDEX;
 
         Buffer() = default;
     };
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <milg/graphics/vk_context.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace milg::graphics {
+    // Transient command pool that hands out primary command buffers and recycles them once reset. Reset only after
+    // the device finished executing everything acquired from it, not thread safe
+    class CommandBufferPool {
+    public:
+        static std::unique_ptr<CommandBufferPool> create(const VulkanContext &context, uint32_t queue_family_index);
+
+        ~CommandBufferPool();
+
+        // Returns a buffer in the initial state, allocated only when every buffer of the pool is already in use
+        VkCommandBuffer acquire();
+        // Resets the pool with a single call and makes every acquired buffer available again
+        void reset();
+
+        uint32_t allocated_count() const;
+
+    private:
+        CommandBufferPool(const VulkanContext &context);
+
+        const VulkanContext &m_context;
+
+        VkCommandPool                m_pool     = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> m_buffers  = {};
+        size_t                       m_acquired = 0;
+    };
+} // namespace milg::graphics
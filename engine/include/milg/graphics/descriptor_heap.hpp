@@ -0,0 +1,95 @@
+#pragma once
+
+#include <milg/graphics/vk_context.hpp>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace milg::graphics {
+    struct DescriptorHeapCreateInfo {
+        uint32_t texture_count       = 4096;
+        uint32_t storage_image_count = 1024;
+        uint32_t buffer_count        = 1024;
+    };
+
+    // One update after bind descriptor set shared by every pipeline, with one array per descriptor type. Resources take
+    // a slot when they are created and keep it for their lifetime, shaders index the arrays with slots passed in push
+    // constants. Freed slots are only handed out again once the frames in flight that may still use them are finished
+    class DescriptorHeap {
+    public:
+        constexpr static uint32_t INVALID_INDEX = UINT32_MAX;
+
+        constexpr static uint32_t TEXTURE_BINDING       = 0;
+        constexpr static uint32_t STORAGE_IMAGE_BINDING = 1;
+        constexpr static uint32_t BUFFER_BINDING        = 2;
+
+        // Counts are clamped to what the device supports
+        static std::unique_ptr<DescriptorHeap> create(const VulkanContext            &context,
+                                                      const DescriptorHeapCreateInfo &create_info);
+
+        ~DescriptorHeap();
+
+        // Allocation returns INVALID_INDEX once the array is full. Writing a slot requires the device to be done with
+        // every frame that used the previous descriptor
+        uint32_t allocate_texture(const VkDescriptorImageInfo &image_info);
+        void     write_texture(uint32_t index, const VkDescriptorImageInfo &image_info);
+        void     free_texture(uint32_t index);
+
+        // Storage images are accessed in VK_IMAGE_LAYOUT_GENERAL
+        uint32_t allocate_storage_image(const VkDescriptorImageInfo &image_info);
+        void     write_storage_image(uint32_t index, const VkDescriptorImageInfo &image_info);
+        void     free_storage_image(uint32_t index);
+
+        uint32_t allocate_buffer(const VkDescriptorBufferInfo &buffer_info);
+        void     write_buffer(uint32_t index, const VkDescriptorBufferInfo &buffer_info);
+        void     free_buffer(uint32_t index);
+
+        // Destroys the resources behind a freed slot once the frames that may still use it are finished, the same
+        // point the slot is reused at. Runs on destruction of the heap at the latest
+        void retire_resource(std::function<void()> destroy);
+
+        // Called when the application starts recording into frame_index, slots and resources retired while that slot
+        // was recorded last time are released from here on
+        void release_retired(uint32_t frame_index);
+
+        VkDescriptorSetLayout layout() const;
+        VkDescriptorSet       set() const;
+        uint32_t              texture_count() const;
+        uint32_t              storage_image_count() const;
+        uint32_t              buffer_count() const;
+
+    private:
+        struct Array {
+            VkDescriptorType                   type     = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+            uint32_t                           capacity = 0;
+            uint32_t                           count    = 0;
+            uint32_t                           next     = 0;
+            std::vector<uint32_t>              free     = {};
+            std::vector<std::vector<uint32_t>> retired  = {};
+        };
+
+        DescriptorHeap(const VulkanContext &context);
+
+        const VulkanContext &m_context;
+
+        VkDescriptorPool      m_pool   = VK_NULL_HANDLE;
+        VkDescriptorSetLayout m_layout = VK_NULL_HANDLE;
+        VkDescriptorSet       m_set    = VK_NULL_HANDLE;
+
+        // Resource creation and destruction aren't limited to one thread, writes to the set have to be serialized
+        mutable std::mutex   m_mutex;
+        std::array<Array, 3>                            m_arrays            = {};
+        std::vector<std::vector<std::function<void()>>> m_retired_resources = {};
+        uint32_t                                        m_frame_index       = 0;
+
+        uint32_t allocate(uint32_t binding);
+        void     write(uint32_t binding, uint32_t index, const VkDescriptorImageInfo *image_info,
+                       const VkDescriptorBufferInfo *buffer_info);
+        void     retire(uint32_t binding, uint32_t index);
+        uint32_t count(uint32_t binding) const;
+    };
+} // namespace milg::graphics
@@ -53,7 +53,10 @@ namespace milg {
     public:
         class Loader : public Asset::Loader {
         public:
-            auto load(std::ifstream &stream) -> LoadResult<void> override;
+            auto decode(ByteView data) -> LoadResult<void> override;
+            auto finalize(const std::shared_ptr<void> &decoded) -> LoadResult<void> override;
+            bool finalize_on_main_thread() const override;
+            bool reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh) override;
         };
 
         typedef std::size_t Id;
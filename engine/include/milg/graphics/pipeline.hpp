@@ -1,5 +1,6 @@
 #pragma once
 
+#include <milg/core/asset_id.hpp>
 #include <milg/graphics/texture.hpp>
 #include <milg/graphics/vk_context.hpp>
 
@@ -19,20 +20,28 @@ namespace milg::graphics {
         uint32_t height = 0;
     };
 
+    // Shaders reach their images through the context's descriptor heap. The heap slots of the bound images are
+    // pushed in front of the pipeline's own push constants, which start at PUSH_CONSTANT_OFFSET
     struct Pipeline {
+        constexpr static uint32_t MAX_IMAGE_BINDINGS   = 8;
+        constexpr static uint32_t PUSH_CONSTANT_OFFSET = MAX_IMAGE_BINDINGS * sizeof(uint32_t);
+
         VkPipeline       pipeline = VK_NULL_HANDLE;
         VkPipelineLayout layout   = VK_NULL_HANDLE;
 
-        VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
-        VkDescriptorSet       set        = VK_NULL_HANDLE;
-
         VkQueryPool query_pool = VK_NULL_HANDLE;
 
         uint32_t query_index    = 0;
         float    execution_time = 0;
 
+        // Shader the pipeline was built from and the asset version it was built with
+        AssetId  shader_id      = {};
+        uint64_t shader_version = 0;
+
         std::vector<std::shared_ptr<Texture>> output_buffers;
 
+        // Pushes the storage image slot of the texture, no descriptor is written. Binding a pipeline resets the
+        // slots, so textures are bound after begin()
         void bind_texture(const std::shared_ptr<VulkanContext> &context, VkCommandBuffer command_buffer,
                           uint32_t binding, const std::shared_ptr<Texture> &texture);
 
@@ -53,6 +62,7 @@ namespace milg::graphics {
         Pipeline *create_compute_pipeline(const std::string &name, const std::string &shader_id,
                                           const std::initializer_list<PipelineOutputDescription> &output_descriptions,
                                           uint32_t texture_input_count, uint32_t push_constant_size = 0);
+        // Also rebuilds pipelines whose shader was hot reloaded since the last frame, without waiting for the device
         void      begin_frame(VkCommandBuffer command_buffer);
         void      end_frame(VkCommandBuffer command_buffer);
 
@@ -65,13 +75,14 @@ namespace milg::graphics {
     private:
         std::shared_ptr<VulkanContext> m_context = nullptr;
 
-        VkDescriptorPool                m_global_descriptor_pool = VK_NULL_HANDLE;
         std::map<std::string, Pipeline> m_pipelines;
-        std::array<VkQueryPool, 2>      m_query_pools = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        std::vector<VkQueryPool>        m_query_pools = {};
 
-        float    m_pre_execution_time = 0;
-        uint32_t m_frame_index        = true;
+        float m_pre_execution_time = 0;
 
         PipelineFactory() = default;
+
+        // VK_NULL_HANDLE when the shader can't be loaded
+        VkPipeline build_pipeline(VkPipelineLayout layout, AssetId shader_id);
     };
 } // namespace milg::graphics
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <milg/graphics/vk_context.hpp>
+
+#include <filesystem>
+#include <memory>
+
+namespace milg::graphics {
+    // VkPipelineCache persisted between runs. The blob is stored per device and driver version, data written by a
+    // different device or driver is never handed to the driver
+    class PipelineCache {
+    public:
+        static std::unique_ptr<PipelineCache> create(const VulkanContext         &context,
+                                                     const std::filesystem::path &directory);
+
+        // Saves the cache before destroying it
+        ~PipelineCache();
+
+        bool save() const;
+
+        VkPipelineCache handle() const;
+
+    private:
+        PipelineCache(const VulkanContext &context);
+
+        const VulkanContext &m_context;
+
+        VkPipelineCache       m_cache = VK_NULL_HANDLE;
+        std::filesystem::path m_path  = {};
+    };
+} // namespace milg::graphics
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <milg/graphics/texture.hpp>
+#include <milg/graphics/vk_context.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace milg::graphics {
+    // How a pass touches an image, decides the layout it needs and what the barrier in front of the pass waits for
+    enum class ImageAccess {
+        COMPUTE_READ,
+        COMPUTE_WRITE,
+        COMPUTE_READ_WRITE,
+        TRANSFER_READ,
+        TRANSFER_WRITE,
+        COLOR_ATTACHMENT_WRITE,
+    };
+
+    using RenderGraphImage = uint32_t;
+
+    struct ImageUse {
+        RenderGraphImage image  = 0;
+        ImageAccess      access = ImageAccess::COMPUTE_READ;
+    };
+
+    struct RenderPassDescription {
+        std::string           name   = {};
+        std::vector<ImageUse> images = {};
+        // Never culled, for passes whose results leave the graph, e.g. a blit to the swapchain
+        bool side_effect = false;
+
+        std::function<void(VkCommandBuffer)> execute = {};
+    };
+
+    // Passes declare the images they use and run in the order they were added. The graph records only the barriers
+    // those uses need, batched into one per pass, culls passes nothing reads from and places transient images whose
+    // lifetimes don't overlap in the same memory
+    class RenderGraph {
+    public:
+        static std::shared_ptr<RenderGraph> create(const std::shared_ptr<VulkanContext> &context);
+
+        // The device must be done with every frame the graph recorded
+        ~RenderGraph();
+
+        // Images that outlive the graph. Their first use in a frame waits for everything recorded before it
+        RenderGraphImage import_texture(const std::shared_ptr<Texture> &texture);
+        // Images only used within a frame, created on compile() and dropped contents at their first use each frame
+        RenderGraphImage create_texture(const std::string &name, const TextureCreateInfo &create_info, uint32_t width,
+                                        uint32_t height);
+        // Keeps the passes writing the image, and the ones they depend on, from being culled
+        void mark_output(RenderGraphImage image);
+
+        void add_pass(RenderPassDescription pass);
+        // Culls passes and places the transient images, execute() compiles on its first call otherwise. Passes can't
+        // be added afterwards
+        void compile();
+        void execute(VkCommandBuffer command_buffer);
+
+        const std::shared_ptr<Texture> &texture(RenderGraphImage image) const;
+
+        uint32_t     pass_count() const;
+        uint32_t     culled_pass_count() const;
+        uint32_t     barrier_count() const;
+        VkDeviceSize transient_memory() const;
+        VkDeviceSize transient_memory_without_aliasing() const;
+
+    private:
+        // Availability and visibility of the last write to a range of memory, shared by the images aliasing it
+        struct MemoryState {
+            VkPipelineStageFlags2 write_stages   = 0;
+            VkAccessFlags2        write_access   = 0;
+            VkPipelineStageFlags2 read_stages    = 0;
+            VkPipelineStageFlags2 visible_stages = 0;
+            VkAccessFlags2        visible_access = 0;
+        };
+
+        struct Image {
+            std::string              name        = {};
+            std::shared_ptr<Texture> texture     = nullptr;
+            TextureCreateInfo        create_info = {};
+            uint32_t                 width       = 0;
+            uint32_t                 height      = 0;
+            bool                     transient   = false;
+            bool                     output      = false;
+            uint32_t                 memory      = 0;
+            VkImageLayout            layout      = VK_IMAGE_LAYOUT_UNDEFINED;
+        };
+
+        struct Pass {
+            RenderPassDescription description = {};
+            bool                  culled      = false;
+        };
+
+        std::shared_ptr<VulkanContext> m_context = nullptr;
+
+        std::vector<Image>         m_images            = {};
+        std::vector<Pass>          m_passes            = {};
+        std::vector<MemoryState>   m_memory_states     = {};
+        std::vector<VmaAllocation> m_transient_memory  = {};
+        bool                       m_compiled          = false;
+        uint32_t                   m_culled_pass_count = 0;
+        uint32_t                   m_barrier_count     = 0;
+
+        VkDeviceSize m_transient_size           = 0;
+        VkDeviceSize m_unaliased_transient_size = 0;
+
+        RenderGraph() = default;
+
+        void cull_passes();
+        void place_transients();
+    };
+} // namespace milg::graphics
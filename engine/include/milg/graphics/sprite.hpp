@@ -2,6 +2,8 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
+
 namespace milg::graphics {
     struct Sprite {
         glm::vec2 position      = {0.0f, 0.0f};
@@ -16,4 +18,17 @@ namespace milg::graphics {
 
     static_assert(sizeof(Sprite) == Sprite::ATTRIB_COUNT * sizeof(float),
                   "Sprite struct might not be packed correctly");
+
+    // What SpriteBatch uploads per sprite, decoded by sprite_batch.vert. Position stays fp32 so tiles far from the
+    // origin keep their pixel alignment, size is fp16, uvs unorm16, color RGBA8 and rotation a 16 bit fraction of a
+    // full turn next to the 16 bit texture index
+    struct SpriteInstance {
+        glm::vec2             position               = {0.0f, 0.0f};
+        uint32_t              size                   = 0;
+        glm::vec<4, uint16_t> uvs                    = {0, 0, 0, 0};
+        uint32_t              color                  = 0;
+        glm::vec<2, uint16_t> rotation_texture_index = {0, 0};
+    };
+
+    static_assert(sizeof(SpriteInstance) == 28, "SpriteInstance struct might not be packed correctly");
 } // namespace milg::graphics
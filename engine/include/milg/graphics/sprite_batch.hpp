@@ -8,36 +8,55 @@
 #include <cstdint>
 #include <glm/glm.hpp>
 #include <memory>
-#include <unordered_map>
+#include <span>
 #include <vector>
 
 namespace milg::graphics {
     class SpriteBatch {
     public:
-        constexpr static uint32_t TEXTURE_DESCRIPTOR_BINDING_COUNT = 1024;
+        constexpr static uint32_t DEFAULT_PAGE_CAPACITY = 4096;
 
+        // Instances handed out by reserve_sprites(), texture_index goes into their rotation_texture_index.y
+        struct Reservation {
+            std::span<SpriteInstance> instances     = {};
+            uint16_t                  texture_index = 0;
+        };
+
+        // Sprites are stored in pages of page_capacity instances, a page is added whenever the ones of the frame
+        // slot are full. With shrink_after_frames set, a frame slot releases the pages it didn't use over that many
+        // frames recorded into it
         static std::shared_ptr<SpriteBatch> create(const std::shared_ptr<VulkanContext> &context,
-                                                   VkFormat albdedo_render_format, uint32_t capacity);
+                                                   VkFormat                              albdedo_render_format,
+                                                   uint32_t page_capacity       = DEFAULT_PAGE_CAPACITY,
+                                                   uint32_t shrink_after_frames = 0);
 
         ~SpriteBatch();
 
+        // Sets the sprite's texture_index to the texture's descriptor heap slot
         void draw_sprite(Sprite &sprite, const std::shared_ptr<Texture> &texture);
+        // Same as draw_sprite() for every sprite, with one reservation per page they end up in. Sprites'
+        // texture_index isn't updated
+        void draw_sprites(std::span<const Sprite> sprites, const std::shared_ptr<Texture> &texture);
+        // For sprites whose texture_index already holds the descriptor_index() of their texture, which may differ
+        // between sprites. Sprites whose texture has no slot are skipped
+        void draw_sprites(std::span<const Sprite> sprites);
+        // Appends up to count sprites to the current batch for the caller to write in place. A reservation never
+        // crosses a page, when the current one fills up fewer are returned and the rest is reserved with another
+        // call. Nothing is reserved for a texture without a slot in the descriptor heap. The memory may be write
+        // combined, so every instance is written once and never read back
+        Reservation reserve_sprites(uint32_t count, const std::shared_ptr<Texture> &texture);
         void reset();
         void begin_batch(const glm::mat4 &matrix);
         void build_batches(VkCommandBuffer command_buffer);
         void render(VkCommandBuffer command_buffer);
 
+        // Sprites the pages of the current frame slot hold
         uint32_t capacity() const;
+        uint32_t page_count() const;
         uint32_t sprite_count() const;
         uint32_t batch_count() const;
-        uint32_t texture_count() const;
 
     private:
-        struct TextureEntry {
-            uint32_t              index      = 0;
-            VkDescriptorImageInfo image_info = {};
-        };
-
         struct BatchConstantData {
             glm::mat4 combined_matrix = glm::mat4(1.0f);
         };
@@ -48,16 +67,26 @@ namespace milg::graphics {
             BatchConstantData constant_data = {};
         };
 
-        std::shared_ptr<VulkanContext> m_context = nullptr;
+        struct Page {
+            std::shared_ptr<Buffer> geometry_buffer = nullptr;
+            // Only set when the geometry buffer can't be mapped, build_batches() copies from it
+            std::shared_ptr<Buffer> backing_buffer = nullptr;
+            // Mapped memory of whichever of the two buffers draw_sprite() writes to
+            SpriteInstance *geometry_data = nullptr;
+        };
 
-        uint32_t                m_capacity        = 0;
-        std::shared_ptr<Buffer> m_geometry_buffer = nullptr;
-        std::shared_ptr<Buffer> m_backing_buffer  = nullptr;
-        std::vector<float>      m_geometry_cache;
+        struct Frame {
+            std::vector<Page> pages = {};
+            // Most pages a frame used since the slot last checked whether it can shrink, and the frames that covers
+            uint32_t peak_page_count = 0;
+            uint32_t recorded_frames = 0;
+        };
 
-        VkDescriptorPool      m_descriptor_pool       = VK_NULL_HANDLE;
-        VkDescriptorSetLayout m_descriptor_set_layout = VK_NULL_HANDLE;
-        VkDescriptorSet       m_descriptor_set        = VK_NULL_HANDLE;
+        std::shared_ptr<VulkanContext> m_context = nullptr;
+
+        uint32_t           m_page_capacity       = 0;
+        uint32_t           m_shrink_after_frames = 0;
+        std::vector<Frame> m_frames;
 
         VkPipelineLayout m_pipeline_layout = VK_NULL_HANDLE;
         VkPipeline       m_pipeline        = VK_NULL_HANDLE;
@@ -65,12 +94,11 @@ namespace milg::graphics {
         VkShaderModule m_vertex_shader_module   = VK_NULL_HANDLE;
         VkShaderModule m_fragment_shader_module = VK_NULL_HANDLE;
 
-        std::unordered_map<std::shared_ptr<Texture>, TextureEntry> m_texture_indices;
-
         uint32_t           m_sprite_count = 0;
         std::vector<Batch> m_batches;
 
-        uint32_t register_texture(const std::shared_ptr<Texture> &texture);
+        std::span<SpriteInstance> reserve(uint32_t count);
+        Page                      create_page() const;
 
         SpriteBatch() = default;
     };
@@ -5,6 +5,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <vector>
 
 namespace milg::graphics {
@@ -17,7 +18,8 @@ namespace milg::graphics {
     class Swapchain {
     public:
         static std::shared_ptr<Swapchain> create(const std::unique_ptr<Window>        &window,
-                                                 const std::shared_ptr<VulkanContext> &context);
+                                                 const std::shared_ptr<VulkanContext> &context,
+                                                 PresentMode                           present_mode);
 
         ~Swapchain();
 
@@ -26,17 +28,40 @@ namespace milg::graphics {
         VkExtent2D         extent() const;
 
         SwapchainImage &get_image(uint32_t index);
-        uint32_t        acquire_next_image(VkSemaphore semaphore, VkFence fence);
-        void            present_image(VkQueue queue, VkSemaphore semaphore);
-        void            transition_current_image(VkCommandBuffer command_buffer, VkImageLayout new_layout);
-        void            blit_to_current_image(VkCommandBuffer command_buffer, VkImage image, VkExtent2D extent);
-        uint32_t        current_image_index() const;
+        // Recreates the swapchain first when it went out of date or suboptimal. The frame value tags the swapchain for
+        // deferred destruction should it be replaced later. Returns nothing while the surface has no area, e.g. when
+        // the window is minimized, the frame is skipped then and the semaphore is left unsignalled
+        std::optional<uint32_t> acquire_next_image(VkSemaphore semaphore, uint64_t frame_value);
+        void                    present_image(VkQueue queue, VkSemaphore semaphore);
+        void                    transition_current_image(VkCommandBuffer command_buffer, VkImageLayout new_layout);
+        void                    blit_to_current_image(VkCommandBuffer command_buffer, VkImage image,
+                                                      VkExtent2D extent);
+        uint32_t                current_image_index() const;
 
+        // Replaces the swapchain without waiting for the device, the old one is kept until release_retired() is
+        // called with the value of the last frame that acquired from it. A surface without area keeps the current
+        // swapchain and leaves it out of date until acquire_next_image() finds the surface has an area again
         void resize(uint32_t width, uint32_t height);
+        void release_retired(uint64_t completed_frame_value);
+        // Recreates the swapchain with the closest mode the surface supports, retiring the old one like resize()
+        void set_present_mode(PresentMode present_mode);
+        VkPresentModeKHR present_mode() const;
+
+        // Id of the last presented frame, 0 before the first present
+        uint64_t present_id() const;
+        // Blocks until the frame with the given id is on screen. Returns false when present wait isn't supported or
+        // the timeout expired, callers then have to pace some other way
+        bool wait_for_present(uint64_t present_id, uint64_t timeout_ns) const;
 
         uint32_t image_count() const;
 
     private:
+        struct RetiredSwapchain {
+            VkSwapchainKHR           swapchain   = VK_NULL_HANDLE;
+            std::vector<VkImageView> views       = {};
+            uint64_t                 frame_value = 0;
+        };
+
         std::shared_ptr<VulkanContext> m_context;
 
         VkSwapchainKHR              m_swapchain            = VK_NULL_HANDLE;
@@ -47,6 +72,12 @@ namespace milg::graphics {
         VkSurfaceCapabilitiesKHR    m_surface_capabilities = {};
         std::vector<SwapchainImage> m_images;
         uint32_t                    m_image_index = 0;
+        uint64_t                    m_present_id  = 0;
+        // Value of the latest frame that acquired an image, retired swapchains are tagged with it
+        uint64_t                    m_frame_value = 0;
+        bool                        m_out_of_date = false;
+
+        std::vector<RetiredSwapchain> m_retired;
 
         void cleanup();
 
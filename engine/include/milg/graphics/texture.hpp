@@ -1,11 +1,15 @@
 #pragma once
 
 #include <milg/core/asset.hpp>
+#include <milg/graphics/barrier_batch.hpp>
+#include <milg/graphics/descriptor_heap.hpp>
 #include <milg/graphics/vk_context.hpp>
 
 #include <cstdint>
 #include <filesystem>
 #include <memory>
+#include <optional>
+#include <vector>
 
 namespace milg::graphics {
     struct TextureCreateInfo {
@@ -17,6 +21,20 @@ namespace milg::graphics {
 
         VkSamplerAddressMode address_mode_u = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
         VkSamplerAddressMode address_mode_v = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+        // Builds the full mip chain for textures created from pixel data, blitted on the GPU when the format allows it
+        bool generate_mips = false;
+    };
+
+    // Decoded pixels, produced off the main thread before the GPU image is created. RGBA8 when format is undefined,
+    // otherwise precompiled levels laid out at level_offsets in the given format
+    struct TextureData {
+        uint32_t                  width         = 0;
+        uint32_t                  height        = 0;
+        Bytes                     pixels        = {};
+        VkFormat                  format        = VK_FORMAT_UNDEFINED;
+        uint32_t                  mip_levels    = 1;
+        std::vector<VkDeviceSize> level_offsets = {};
     };
 
     class Texture {
@@ -25,6 +43,7 @@ namespace milg::graphics {
         public:
             Loader() = delete;
             Loader(std::weak_ptr<VulkanContext> ctx);
+            Loader(std::weak_ptr<VulkanContext> ctx, const TextureCreateInfo &create_info);
             Loader(const Loader &) = default;
             Loader(Loader &&)      = default;
 
@@ -33,21 +52,43 @@ namespace milg::graphics {
 
             ~Loader() = default;
 
-            auto load(std::ifstream &stream) -> LoadResult<void> override;
+            auto candidates(const std::filesystem::path &path) const -> std::vector<std::filesystem::path> override;
+            auto decode(ByteView data) -> LoadResult<void> override;
+            auto finalize(const std::shared_ptr<void> &decoded) -> LoadResult<void> override;
+            bool finalize_on_main_thread() const override;
+            auto measure(const std::shared_ptr<void> &asset) const -> AssetMemory override;
+            bool reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh) override;
 
         private:
             std::weak_ptr<VulkanContext> ctx;
+            TextureCreateInfo            create_info;
         };
 
         static std::shared_ptr<Texture> load_from_data(const std::shared_ptr<VulkanContext> &context,
-                                                       const TextureCreateInfo &create_info, const Bytes &bytes);
+                                                       const TextureCreateInfo &create_info, ByteView bytes);
+        static std::shared_ptr<Texture> create_from_pixels(const std::shared_ptr<VulkanContext> &context,
+                                                           const TextureCreateInfo              &create_info,
+                                                           const TextureData                    &data);
+        static std::optional<TextureData> decode(ByteView bytes);
+        static std::optional<TextureData> decode_ktx2(ByteView bytes);
 
         static std::shared_ptr<Texture> create(const std::shared_ptr<VulkanContext> &context,
                                                const TextureCreateInfo &create_info, uint32_t width, uint32_t height);
+        // Places the image at offset in memory owned by the caller, which has to outlive the texture
+        static std::shared_ptr<Texture> create_aliased(const std::shared_ptr<VulkanContext> &context,
+                                                       const TextureCreateInfo &create_info, uint32_t width,
+                                                       uint32_t height, VmaAllocation memory, VkDeviceSize offset);
+        static VkMemoryRequirements     memory_requirements(const std::shared_ptr<VulkanContext> &context,
+                                                            const TextureCreateInfo &create_info, uint32_t width,
+                                                            uint32_t height);
 
         ~Texture();
 
         void transition_layout(VkCommandBuffer command_buffer, VkImageLayout new_layout);
+        // Queues the transition instead of recording it, the layout is considered changed once the batch is flushed
+        void transition_layout(BarrierBatch &batch, VkImageLayout new_layout);
+        // Records a layout the image was moved to by a barrier recorded elsewhere, e.g. by the render graph
+        void set_layout(VkImageLayout layout);
         void blit_from(const std::shared_ptr<Texture> &src, VkCommandBuffer command_buffer);
 
         VkImage               handle() const;
@@ -58,6 +99,10 @@ namespace milg::graphics {
         VmaAllocation         allocation() const;
         VmaAllocationInfo     allocation_info() const;
         VkImageLayout         layout() const;
+        // Slots in the context's descriptor heap, fixed for the texture's lifetime. INVALID_INDEX for images created
+        // without VK_IMAGE_USAGE_SAMPLED_BIT or VK_IMAGE_USAGE_STORAGE_BIT respectively
+        uint32_t descriptor_index() const;
+        uint32_t storage_descriptor_index() const;
 
         uint32_t width() const;
         uint32_t height() const;
@@ -68,14 +113,16 @@ namespace milg::graphics {
     private:
         std::shared_ptr<VulkanContext> m_context = nullptr;
 
-        VkImage               m_handle          = VK_NULL_HANDLE;
-        VkImageView           m_image_view      = VK_NULL_HANDLE;
-        VkSampler             m_sampler         = VK_NULL_HANDLE;
-        VkFormat              m_format          = VK_FORMAT_UNDEFINED;
-        VkDescriptorImageInfo m_descriptor      = {};
-        VmaAllocation         m_allocation      = VK_NULL_HANDLE;
-        VmaAllocationInfo     m_allocation_info = {};
-        VkImageLayout         m_layout          = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImage               m_handle                   = VK_NULL_HANDLE;
+        VkImageView           m_image_view               = VK_NULL_HANDLE;
+        VkSampler             m_sampler                  = VK_NULL_HANDLE;
+        VkFormat              m_format                   = VK_FORMAT_UNDEFINED;
+        VkDescriptorImageInfo m_descriptor               = {};
+        VmaAllocation         m_allocation               = VK_NULL_HANDLE;
+        VmaAllocationInfo     m_allocation_info          = {};
+        VkImageLayout         m_layout                   = VK_IMAGE_LAYOUT_UNDEFINED;
+        uint32_t              m_descriptor_index         = DescriptorHeap::INVALID_INDEX;
+        uint32_t              m_storage_descriptor_index = DescriptorHeap::INVALID_INDEX;
 
         uint32_t m_width       = 0;
         uint32_t m_height      = 0;
@@ -84,6 +131,15 @@ namespace milg::graphics {
         uint32_t m_layer_count = 0;
 
         Texture() = default;
+
+        static std::shared_ptr<Texture> create_from_image(const std::shared_ptr<VulkanContext> &context,
+                                                          const TextureCreateInfo &create_info, VkImage image,
+                                                          VmaAllocation            allocation,
+                                                          const VmaAllocationInfo &allocation_info, uint32_t width,
+                                                          uint32_t height);
+
+        // Exchanges the GPU resources of two textures, the caller makes sure neither is in use by the device
+        void swap(Texture &other);
     };
 
 } // namespace milg::graphics
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <milg/graphics/vk_context.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace milg::graphics {
+    // Batches staging copies into one submission on the transfer queue, ownership of the uploaded resources is handed
+    // to the graphics queue before the batch's timeline value is signalled
+    class UploadQueue {
+    public:
+        static std::unique_ptr<UploadQueue> create(const VulkanContext &context, VkDeviceSize staging_size);
+
+        ~UploadQueue();
+
+        // Copies the pixels into the first mip level, the image ends up in SHADER_READ_ONLY_OPTIMAL once the batch
+        // completes. Returns the timeline value of the batch the upload is part of
+        uint64_t upload_image(VkImage image, VkExtent3D extent, const void *data, VkDeviceSize size);
+        // Copies one tightly packed level per offset, levels past the provided ones up to mip_levels are generated by
+        // blitting on the graphics queue, so the format has to support linear blits in that case
+        uint64_t upload_image(VkImage image, VkExtent3D extent, uint32_t mip_levels,
+                              std::span<const VkDeviceSize> level_offsets, const void *data, VkDeviceSize size);
+        uint64_t upload_buffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size);
+
+        // Submits everything recorded since the last flush, later graphics queue submissions see the uploaded data
+        uint64_t flush();
+        bool     is_complete(uint64_t value) const;
+        void     wait(uint64_t value);
+
+        VkSemaphore timeline_semaphore() const;
+        bool        has_dedicated_transfer_queue() const;
+
+    private:
+        struct StagingBuffer {
+            VkBuffer      buffer     = VK_NULL_HANDLE;
+            VmaAllocation allocation = VK_NULL_HANDLE;
+        };
+
+        struct Batch {
+            uint64_t                   value                   = 0;
+            uint64_t                   ring_end                = 0;
+            VkCommandBuffer            transfer_command_buffer = VK_NULL_HANDLE;
+            VkCommandBuffer            graphics_command_buffer = VK_NULL_HANDLE;
+            std::vector<StagingBuffer> dedicated_staging       = {};
+        };
+
+        struct Allocation {
+            VkBuffer     buffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+        };
+
+        UploadQueue(const VulkanContext &context);
+
+        const VulkanContext &m_context;
+
+        bool          m_dedicated_transfer    = false;
+        VkCommandPool m_transfer_command_pool = VK_NULL_HANDLE;
+        VkCommandPool m_graphics_command_pool = VK_NULL_HANDLE;
+        VkSemaphore   m_timeline_semaphore    = VK_NULL_HANDLE;
+        uint64_t      m_timeline_value        = 0;
+
+        // Ring offsets grow monotonically, the position in the buffer is the offset modulo the ring size
+        VkBuffer      m_ring_buffer     = VK_NULL_HANDLE;
+        VmaAllocation m_ring_allocation = VK_NULL_HANDLE;
+        std::byte    *m_ring_data       = nullptr;
+        VkDeviceSize  m_ring_size       = 0;
+        VkDeviceSize  m_ring_alignment  = 0;
+        uint64_t      m_ring_head       = 0;
+        uint64_t      m_ring_tail       = 0;
+
+        Batch             m_recording = {};
+        std::deque<Batch> m_in_flight = {};
+
+        Allocation allocate(const void *data, VkDeviceSize size);
+        void       begin_recording();
+        void       reclaim();
+        uint64_t   pending_value() const;
+    };
+} // namespace milg::graphics
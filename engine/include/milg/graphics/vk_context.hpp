@@ -22,9 +22,15 @@ namespace milg {
 }
 
 namespace milg::graphics {
+    class DescriptorHeap;
+    class PipelineCache;
+    class UploadQueue;
+
     class VulkanContext {
     public:
-        static std::shared_ptr<VulkanContext> create(const std::unique_ptr<Window> &window);
+        // Between 2 and 3 frames can be in flight, more only adds latency
+        static std::shared_ptr<VulkanContext> create(const std::unique_ptr<Window> &window,
+                                                     uint32_t                       frames_in_flight = 2);
 
         ~VulkanContext();
 
@@ -37,11 +43,26 @@ namespace milg::graphics {
         const VolkDeviceTable                  &device_table() const;
         uint32_t                                graphics_queue_family_index() const;
         VkQueue                                 graphics_queue() const;
+        uint32_t                                transfer_queue_family_index() const;
+        VkQueue                                 transfer_queue() const;
+        bool                                    supports_bc_compression() const;
+        bool                                    supports_present_wait() const;
         VmaAllocator                            allocator() const;
+        UploadQueue                            &upload_queue() const;
+        // Passed to every pipeline creation, persisted on disk when the context is destroyed
+        VkPipelineCache pipeline_cache() const;
+        // Bindless descriptors of every texture, storage image and storage buffer, bound as set 0 by every pipeline
+        DescriptorHeap &descriptor_heap() const;
+
+        // Slot of the frame being recorded, resources kept per slot are no longer in use by the device once the
+        // application starts recording into it
+        uint32_t frames_in_flight() const;
+        uint32_t frame_index() const;
+        void     set_frame_index(uint32_t frame_index);
 
         uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
         void     transition_image_layout(VkCommandBuffer command_buffer, VkImage image, VkImageLayout old_layout,
-                                         VkImageLayout new_layout) const;
+                                         VkImageLayout new_layout, uint32_t mip_levels = 1) const;
 
         VkCommandBuffer begin_single_time_commands() const;
         void            end_single_time_commands(VkCommandBuffer command_buffer) const;
@@ -58,8 +79,17 @@ namespace milg::graphics {
         uint32_t                         m_graphics_queue_family_index = 0;
         VkDebugUtilsMessengerEXT         m_debug_messenger             = VK_NULL_HANDLE;
         VkQueue                          m_graphics_queue              = VK_NULL_HANDLE;
+        uint32_t                         m_transfer_queue_family_index = 0;
+        VkQueue                          m_transfer_queue              = VK_NULL_HANDLE;
+        bool                             m_bc_compression              = false;
+        bool                             m_present_wait                = false;
         VmaAllocator                     m_allocator                   = VK_NULL_HANDLE;
+        uint32_t                         m_frames_in_flight            = 2;
+        uint32_t                         m_frame_index                 = 0;
 
-        VkCommandPool m_command_pool = VK_NULL_HANDLE;
+        VkCommandPool                   m_command_pool    = VK_NULL_HANDLE;
+        std::unique_ptr<UploadQueue>    m_upload_queue    = nullptr;
+        std::unique_ptr<PipelineCache>  m_pipeline_cache  = nullptr;
+        std::unique_ptr<DescriptorHeap> m_descriptor_heap = nullptr;
     };
 } // namespace milg::graphics
@@ -4,6 +4,7 @@
 #include <milg/core/asset.hpp>
 #include <milg/core/event.hpp>
 #include <milg/core/events.hpp>
+#include <milg/core/jobs.hpp>
 #include <milg/core/layer.hpp>
 #include <milg/core/logging.hpp>
 #include <milg/core/window.hpp>
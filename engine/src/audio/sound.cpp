@@ -7,31 +7,33 @@
 static const ma_uint32 DEFAULT_FLAGS = MA_SOUND_FLAG_NO_DEFAULT_ATTACHMENT;
 
 namespace milg::audio {
-    Sound::Sound(const std::shared_ptr<Bytes> &bytes) {
-        auto      engine         = get_engine();
-        auto      sample_rate    = ma_engine_get_sample_rate(engine);
-        auto      channels       = ma_engine_get_channels(engine);
-        auto      decoder_config = ma_decoder_config_init(ma_format_f32, channels, sample_rate);
-        ma_uint64 frame_count    = 0;
-        void     *frames         = NULL;
-        auto      res = ma_decode_memory(bytes->data(), bytes->size(), &decoder_config, &frame_count, &frames);
-        if (res != MA_SUCCESS) {
-            throw std::runtime_error("Decoding sound data failed");
-        }
-        auto buffer_config = ma_audio_buffer_config_init(ma_format_f32, channels, frame_count, frames, NULL);
+    SoundData::~SoundData() {
+        ma_free(this->frames, NULL);
+    }
+
+    Sound::Sound(const std::shared_ptr<Bytes> &bytes) : Sound(Sound::decode(*bytes)) {
+    }
+
+    Sound::Sound(const std::shared_ptr<SoundData> &data) : data(data) {
+        auto engine        = get_engine();
+        auto buffer_config = ma_audio_buffer_config_init(ma_format_f32, data->channels, data->frame_count,
+                                                         data->frames, NULL);
 
         if (ma_audio_buffer_init(&buffer_config, &this->buffer) != MA_SUCCESS) {
             throw std::runtime_error("Initializing sound buffer failed");
         }
 
-        res = ma_sound_init_from_data_source(engine, &buffer, DEFAULT_FLAGS, NULL, &this->sound);
+        auto res = ma_sound_init_from_data_source(engine, &buffer, DEFAULT_FLAGS, NULL, &this->sound);
         if (res != MA_SUCCESS) {
+            ma_audio_buffer_uninit(&this->buffer);
+
             throw std::runtime_error("Loading sound failed");
         }
     }
 
     Sound::~Sound() {
         ma_sound_uninit(static_cast<ma_sound *>(this->get_handle()));
+        ma_audio_buffer_uninit(&this->buffer);
     }
 
     ma_node *Sound::get_handle() {
@@ -49,4 +51,45 @@ namespace milg::audio {
     void Sound::set_volume(float volume) {
         ma_sound_set_volume(static_cast<ma_sound *>(this->get_handle()), volume);
     }
+
+    const std::shared_ptr<SoundData> &Sound::get_data() const {
+        return this->data;
+    }
+
+    std::shared_ptr<SoundData> Sound::decode(ByteView bytes) {
+        auto engine         = get_engine();
+        auto sample_rate    = ma_engine_get_sample_rate(engine);
+        auto channels       = ma_engine_get_channels(engine);
+        auto decoder_config = ma_decoder_config_init(ma_format_f32, channels, sample_rate);
+        auto data           = std::make_shared<SoundData>();
+
+        auto res = ma_decode_memory(bytes.data(), bytes.size(), &decoder_config, &data->frame_count, &data->frames);
+        if (res != MA_SUCCESS) {
+            throw std::runtime_error("Decoding sound data failed");
+        }
+        data->channels = channels;
+
+        return data;
+    }
+} // namespace milg::audio
+
+namespace milg::audio {
+    auto Sound::Loader::decode(ByteView data) -> LoadResult<void> {
+        return Sound::decode(data);
+    }
+
+    auto Sound::Loader::finalize(const std::shared_ptr<void> &decoded) -> LoadResult<void> {
+        return std::make_shared<Sound>(std::static_pointer_cast<SoundData>(decoded));
+    }
+
+    // Sounds are attached to the engine's node graph, which is otherwise only touched from the main thread
+    bool Sound::Loader::finalize_on_main_thread() const {
+        return true;
+    }
+
+    auto Sound::Loader::measure(const std::shared_ptr<void> &asset) const -> AssetMemory {
+        const auto &data = std::static_pointer_cast<Sound>(asset)->get_data();
+
+        return {.cpu = static_cast<size_t>(data->frame_count * data->channels * sizeof(float))};
+    }
 } // namespace milg::audio
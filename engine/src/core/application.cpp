@@ -5,37 +5,50 @@
 #include <milg/core/events.hpp>
 #include <milg/core/layer.hpp>
 #include <milg/core/logging.hpp>
+#include <milg/graphics/command_buffer_pool.hpp>
 #include <milg/graphics/map.hpp>
 #include <milg/graphics/swapchain.hpp>
 #include <milg/graphics/texture.hpp>
+#include <milg/graphics/upload_queue.hpp>
 #include <milg/graphics/vk_context.hpp>
 
+#include <array>
 #include <chrono>
 #include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <imgui.h>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
 
 namespace milg {
     Application *Application::s_instance = nullptr;
 
-    Application::Application(int argc, char **argv, const WindowCreateInfo &window_create_info) {
+    Application::Application(int argc, char **argv, const WindowCreateInfo &window_create_info,
+                             uint32_t frames_in_flight) {
         Application::s_instance = this;
 
         Logging::init();
 
         m_window      = Window::create(window_create_info);
-        m_context     = graphics::VulkanContext::create(m_window);
-        m_swapchain   = graphics::Swapchain::create(m_window, m_context);
+        m_context     = graphics::VulkanContext::create(m_window, frames_in_flight);
+        m_swapchain   = graphics::Swapchain::create(m_window, m_context, window_create_info.present_mode);
+        m_low_latency = window_create_info.low_latency;
         m_imgui_layer = ImGuiLayer::create(m_swapchain, m_window, m_context);
+        m_scheduler   = std::make_unique<jobs::Scheduler>();
         init_frame_resources();
 
         m_window->set_event_callback([this](Event &event) {
             on_event(event);
         });
 
+        AssetStore::set_scheduler(m_scheduler.get());
         AssetStore::register_loader<graphics::Texture>(std::make_shared<graphics::Texture::Loader>(m_context));
         AssetStore::register_loader<Map>(std::move(std::make_unique<Map::Loader>()));
+        AssetStore::register_loader<audio::Sound>(std::make_shared<audio::Sound::Loader>());
 
         audio::init();
     }
@@ -52,27 +65,45 @@ namespace milg {
         }
 
         AssetStore::unload_all();
+        AssetStore::set_scheduler(nullptr);
         audio::destroy();
     }
 
     int Application::run(float min_frametime) {
-        auto     current_time   = std::chrono::high_resolution_clock::now();
+        using Clock = std::chrono::steady_clock;
+
+        // Sleeps overshoot by up to the scheduler's granularity, the last stretch before the deadline is spun instead
+        constexpr auto     spin_margin             = std::chrono::milliseconds(2);
+        constexpr uint64_t present_wait_timeout_ns = 100'000'000;
+
+        const auto min_frame_duration = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<float, std::chrono::seconds::period>(min_frametime));
+
+        auto     current_time   = Clock::now();
         uint32_t elapsed_frames = 0;
         float    elapsed_time   = 0.0f;
 
         while (m_running) {
-            auto  new_time = std::chrono::high_resolution_clock::now();
+            auto new_time = Clock::now();
+            if (min_frametime != 0.0f) {
+                const auto target_time = current_time + min_frame_duration;
+                if (target_time - new_time > spin_margin) {
+                    std::this_thread::sleep_until(target_time - spin_margin);
+                }
+
+                while ((new_time = Clock::now()) < target_time) {
+                    std::this_thread::yield();
+                }
+            }
+
             float delta_time =
                 std::chrono::duration<float, std::chrono::seconds::period>(new_time - current_time).count();
             current_time = new_time;
 
-            if (min_frametime != 0.0f) {
-                while (delta_time < min_frametime) {
-                    new_time = std::chrono::high_resolution_clock::now();
-                    delta_time +=
-                        std::chrono::duration<float, std::chrono::seconds::period>(new_time - current_time).count();
-                    current_time = new_time;
-                }
+            // Sampling input only once the previous frame is on screen keeps frames from queueing up behind the
+            // display. Without present wait the device finishing the previous frame is the closest point available
+            if (m_low_latency && !m_swapchain->wait_for_present(m_swapchain->present_id(), present_wait_timeout_ns)) {
+                wait_for_frame(m_frame_resources.frame_value);
             }
 
             if (!m_window->poll_events()) {
@@ -80,16 +111,42 @@ namespace milg {
                 break;
             }
 
-            uint32_t frame_index      = m_frame_resources.current_frame;
-            uint32_t last_frame_index = m_frame_resources.last_frame;
+            // Switched between frames, the swapchain can't be recreated while an image of it is acquired
+            if (m_pending_present_mode.has_value()) {
+                m_swapchain->set_present_mode(*m_pending_present_mode);
+                m_pending_present_mode.reset();
+            }
+
+            uint32_t frame_index = m_frame_resources.current_frame;
 
-            std::vector<VkSubmitInfo> submit_infos;
+            // Only the frame that last used this slot has to be finished before its command buffers and semaphores
+            // are reused, the other slots keep the GPU busy while this frame is recorded
+            wait_for_frame(m_frame_resources.frame_values[frame_index]);
+            m_context->set_frame_index(frame_index);
 
-            uint32_t swapchain_image_index = m_swapchain->acquire_next_image(
-                m_frame_resources.image_available_semaphores[frame_index], VK_NULL_HANDLE);
+            // Every buffer recorded for this slot goes back to its pool at once, steady state frames don't allocate
+            m_frame_resources.command_pools[frame_index]->reset();
+            for (auto &pool : m_frame_resources.worker_pools[frame_index]) {
+                pool->reset();
+            }
+            m_frame_resources.leased_command_buffers[frame_index].clear();
+
+            // Swapchains replaced by earlier resizes are destroyed once every frame that acquired from them finished,
+            // frames complete in submission order so reaching this slot's value covers all earlier ones
+            m_swapchain->release_retired(m_frame_resources.frame_values[frame_index]);
+
+            const auto acquired_image_index = m_swapchain->acquire_next_image(
+                m_frame_resources.image_available_semaphores[frame_index], frame_value());
+            if (!acquired_image_index.has_value()) {
+                // Nothing to present to while the window is minimized, the frame is skipped without using the slot
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            const uint32_t swapchain_image_index = *acquired_image_index;
 
             {
                 auto &command_buffer = m_frame_resources.pre_frame_command_buffers[frame_index];
+                command_buffer       = m_frame_resources.command_pools[frame_index]->acquire();
                 const VkCommandBufferBeginInfo command_buffer_begin_info = {
                     .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
                     .pNext            = nullptr,
@@ -99,53 +156,37 @@ namespace milg {
                 VK_CHECK(vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info));
                 m_swapchain->transition_current_image(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
                 vkEndCommandBuffer(command_buffer);
-
-                VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-                const VkSubmitInfo   submit_info         = {
-                              .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                              .pNext                = nullptr,
-                              .waitSemaphoreCount   = 1,
-                              .pWaitSemaphores      = &m_frame_resources.image_available_semaphores[frame_index],
-                              .pWaitDstStageMask    = &wait_dst_stage_mask,
-                              .commandBufferCount   = 1,
-                              .pCommandBuffers      = &command_buffer,
-                              .signalSemaphoreCount = 1,
-                              .pSignalSemaphores    = &m_frame_resources.image_ready_semaphores[frame_index],
-                };
-                submit_infos.push_back(submit_info);
             }
 
             ImGui_ImplVulkan_NewFrame();
             ImGui_ImplSDL2_NewFrame();
             ImGui::NewFrame();
 
-            // TODO: This is not exactly a correct place to wait for the fence, resulting almost the same effect as a
-            // waitIdle call, if performance tanks, this should be moved further down
-            m_context->device_table().vkWaitForFences(m_context->device(), 1,
-                                                      &m_frame_resources.fences[last_frame_index], VK_TRUE, UINT64_MAX);
+            AssetStore::update();
 
             for (auto layer : m_layers) {
                 layer->on_update(delta_time);
             }
 
-            VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            const VkSubmitInfo   submit_info         = {
-                          .sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                          .pNext              = nullptr,
-                          .waitSemaphoreCount = 1,
-                          .pWaitSemaphores    = &m_frame_resources.image_ready_semaphores[frame_index],
-                          .pWaitDstStageMask  = &wait_dst_stage_mask,
-                          .commandBufferCount =
-                    static_cast<uint32_t>(m_frame_resources.leased_command_buffers[frame_index].size()),
-                          .pCommandBuffers      = m_frame_resources.leased_command_buffers[frame_index].data(),
-                          .signalSemaphoreCount = 1,
-                          .pSignalSemaphores    = &m_frame_resources.layer_render_finished_semaphores[frame_index],
-            };
-            submit_infos.push_back(submit_info);
+            // Recordings still running on workers finish before their buffers are gathered, the order of the submit
+            // is the order the buffers were requested in, not the order the workers finished in. The main thread
+            // picks up recordings itself while it waits
+            m_scheduler->wait(m_frame_resources.recordings);
+
+            // The whole frame goes out as one batch, the swapchain transitions bracket the layers' buffers
+            std::vector<VkCommandBuffer> frame_command_buffers = {
+                m_frame_resources.pre_frame_command_buffers[frame_index]};
+            {
+                std::lock_guard lock(m_frame_resources.recording_mutex);
+
+                const auto &leased = m_frame_resources.leased_command_buffers[frame_index];
+                frame_command_buffers.insert(frame_command_buffers.end(), leased.begin(), leased.end());
+            }
 
             ImGui::Render();
             {
                 auto &command_buffer = m_frame_resources.post_frame_command_buffers[frame_index];
+                command_buffer       = m_frame_resources.command_pools[frame_index]->acquire();
                 const VkCommandBufferBeginInfo command_buffer_begin_info = {
                     .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
                     .pNext            = nullptr,
@@ -186,39 +227,74 @@ namespace milg {
                 m_swapchain->transition_current_image(command_buffer, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
                 vkEndCommandBuffer(command_buffer);
 
-                VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-                const VkSubmitInfo   submit_info         = {
-                              .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                              .pNext                = nullptr,
-                              .waitSemaphoreCount   = 1,
-                              .pWaitSemaphores      = &m_frame_resources.layer_render_finished_semaphores[frame_index],
-                              .pWaitDstStageMask    = &wait_dst_stage_mask,
-                              .commandBufferCount   = 1,
-                              .pCommandBuffers      = &command_buffer,
-                              .signalSemaphoreCount = 1,
-                              .pSignalSemaphores    = &m_frame_resources.render_finished_semaphores[frame_index],
-                };
-                submit_infos.push_back(submit_info);
+                frame_command_buffers.push_back(command_buffer);
             }
 
-            if (m_frame_resources.leased_command_buffers[last_frame_index].size() > 0) {
-                m_context->device_table().vkFreeCommandBuffers(
-                    m_context->device(), m_frame_resources.command_pool,
-                    static_cast<uint32_t>(m_frame_resources.leased_command_buffers[last_frame_index].size()),
-                    m_frame_resources.leased_command_buffers[last_frame_index].data());
-
-                m_frame_resources.leased_command_buffers[last_frame_index].clear();
+            // Uploads recorded this frame (textures finalized by the asset store, layer updates) are submitted as one
+            // batch ahead of the frame's own work
+            m_context->upload_queue().flush();
+
+            std::vector<VkCommandBufferSubmitInfo> command_buffer_infos;
+            command_buffer_infos.reserve(frame_command_buffers.size());
+            for (VkCommandBuffer command_buffer : frame_command_buffers) {
+                command_buffer_infos.push_back({
+                    .sType         = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+                    .pNext         = nullptr,
+                    .commandBuffer = command_buffer,
+                    .deviceMask    = 0,
+                });
             }
 
-            m_context->device_table().vkResetFences(m_context->device(), 1, &m_frame_resources.fences[frame_index]);
-            VK_CHECK(vkQueueSubmit(m_context->graphics_queue(), static_cast<uint32_t>(submit_infos.size()),
-                                   submit_infos.data(), m_frame_resources.fences[frame_index]));
+            const uint64_t frame_value                  = ++m_frame_resources.frame_value;
+            m_frame_resources.frame_values[frame_index] = frame_value;
+
+            // Only the swapchain image has to wait for the acquire, the first barrier on it chains off these stages
+            const VkSemaphoreSubmitInfo wait_info = {
+                .sType       = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                .pNext       = nullptr,
+                .semaphore   = m_frame_resources.image_available_semaphores[frame_index],
+                .value       = 0,
+                .stageMask   = VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .deviceIndex = 0,
+            };
+
+            // Presentation can't wait on a timeline semaphore, so a binary one is signalled alongside it
+            const std::array<VkSemaphoreSubmitInfo, 2> signal_infos = {
+                VkSemaphoreSubmitInfo{
+                    .sType       = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                    .pNext       = nullptr,
+                    .semaphore   = m_frame_resources.frame_semaphore,
+                    .value       = frame_value,
+                    .stageMask   = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                    .deviceIndex = 0,
+                },
+                VkSemaphoreSubmitInfo{
+                    .sType       = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                    .pNext       = nullptr,
+                    .semaphore   = m_frame_resources.render_finished_semaphores[frame_index],
+                    .value       = 0,
+                    .stageMask   = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                    .deviceIndex = 0,
+                },
+            };
+
+            const VkSubmitInfo2 submit_info = {
+                .sType                    = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+                .pNext                    = nullptr,
+                .flags                    = 0,
+                .waitSemaphoreInfoCount   = 1,
+                .pWaitSemaphoreInfos      = &wait_info,
+                .commandBufferInfoCount   = static_cast<uint32_t>(command_buffer_infos.size()),
+                .pCommandBufferInfos      = command_buffer_infos.data(),
+                .signalSemaphoreInfoCount = static_cast<uint32_t>(signal_infos.size()),
+                .pSignalSemaphoreInfos    = signal_infos.data(),
+            };
+            VK_CHECK(m_context->device_table().vkQueueSubmit2(m_context->graphics_queue(), 1, &submit_info,
+                                                              VK_NULL_HANDLE));
             m_swapchain->present_image(m_context->graphics_queue(),
                                        m_frame_resources.render_finished_semaphores[frame_index]);
 
-            m_frame_resources.last_frame = m_frame_resources.current_frame;
-            m_frame_resources.current_frame =
-                (m_frame_resources.current_frame + 1) % m_frame_resources.MAX_FRAMES_IN_FLIGHT;
+            m_frame_resources.current_frame = (m_frame_resources.current_frame + 1) % m_context->frames_in_flight();
 
             elapsed_frames++;
             elapsed_time += delta_time;
@@ -258,6 +334,50 @@ namespace milg {
         return m_swapchain;
     }
 
+    VkSemaphore Application::frame_semaphore() const {
+        return m_frame_resources.frame_semaphore;
+    }
+
+    uint64_t Application::frame_value() const {
+        return m_frame_resources.frame_value + 1;
+    }
+
+    bool Application::is_frame_complete(uint64_t value) const {
+        uint64_t current_value = 0;
+        VK_CHECK(m_context->device_table().vkGetSemaphoreCounterValue(
+            m_context->device(), m_frame_resources.frame_semaphore, &current_value));
+
+        return current_value >= value;
+    }
+
+    void Application::wait_for_frame(uint64_t value) const {
+        const VkSemaphoreWaitInfo wait_info = {
+            .sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .pNext          = nullptr,
+            .flags          = 0,
+            .semaphoreCount = 1,
+            .pSemaphores    = &m_frame_resources.frame_semaphore,
+            .pValues        = &value,
+        };
+        VK_CHECK(m_context->device_table().vkWaitSemaphores(m_context->device(), &wait_info, UINT64_MAX));
+    }
+
+    jobs::Scheduler &Application::scheduler() const {
+        return *m_scheduler;
+    }
+
+    void Application::set_present_mode(PresentMode present_mode) {
+        m_pending_present_mode = present_mode;
+    }
+
+    void Application::set_low_latency(bool low_latency) {
+        m_low_latency = low_latency;
+    }
+
+    bool Application::low_latency() const {
+        return m_low_latency;
+    }
+
     uint32_t Application::frames_per_second() const {
         return m_frames_per_second;
     }
@@ -345,32 +465,72 @@ namespace milg {
     }
 
     VkCommandBuffer Application::acquire_command_buffer() {
-        VkCommandBuffer             command_buffer               = VK_NULL_HANDLE;
-        VkCommandBufferAllocateInfo command_buffer_allocate_info = {
-            .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .pNext              = nullptr,
-            .commandPool        = m_frame_resources.command_pool,
-            .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = 1,
-        };
-        VK_CHECK(vkAllocateCommandBuffers(m_context->device(), &command_buffer_allocate_info, &command_buffer));
+        const uint32_t  frame_index    = m_frame_resources.current_frame;
+        VkCommandBuffer command_buffer = m_frame_resources.command_pools[frame_index]->acquire();
+
+        std::lock_guard lock(m_frame_resources.recording_mutex);
+        m_frame_resources.leased_command_buffers[frame_index].push_back(command_buffer);
+
+        return command_buffer;
+    }
 
-        m_frame_resources.leased_command_buffers[m_frame_resources.current_frame].push_back(command_buffer);
+    void Application::record_command_buffer(std::function<void(VkCommandBuffer)> recorder) {
+        const uint32_t   frame_index = m_frame_resources.current_frame;
+        VkCommandBuffer *slot        = nullptr;
+        {
+            // The slot keeps the buffer's place in the submit order, deque elements don't move on push_back
+            std::lock_guard lock(m_frame_resources.recording_mutex);
+            slot = &m_frame_resources.leased_command_buffers[frame_index].emplace_back(VK_NULL_HANDLE);
+        }
+
+        m_scheduler->submit(
+            [this, frame_index, slot, recorder = std::move(recorder)]() {
+                graphics::CommandBufferPool *pool = nullptr;
+                {
+                    std::lock_guard lock(m_frame_resources.recording_mutex);
+                    auto           &idle_pools = m_frame_resources.idle_worker_pools[frame_index];
+                    if (idle_pools.empty()) {
+                        auto &pools = m_frame_resources.worker_pools[frame_index];
+                        pools.push_back(
+                            graphics::CommandBufferPool::create(*m_context, m_context->graphics_queue_family_index()));
+                        idle_pools.push_back(pools.back().get());
+                    }
+
+                    pool = idle_pools.back();
+                    idle_pools.pop_back();
+                }
 
-        return m_frame_resources.leased_command_buffers[m_frame_resources.current_frame].back();
+                VkCommandBuffer                command_buffer            = pool->acquire();
+                const VkCommandBufferBeginInfo command_buffer_begin_info = {
+                    .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .pNext            = nullptr,
+                    .flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                    .pInheritanceInfo = nullptr,
+                };
+                VK_CHECK(vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info));
+                recorder(command_buffer);
+                VK_CHECK(vkEndCommandBuffer(command_buffer));
+
+                {
+                    std::lock_guard lock(m_frame_resources.recording_mutex);
+                    *slot = command_buffer;
+                    m_frame_resources.idle_worker_pools[frame_index].push_back(pool);
+                }
+            },
+            &m_frame_resources.recordings);
     }
 
     void Application::init_frame_resources() {
-        m_frame_resources.leased_command_buffers.resize(m_frame_resources.MAX_FRAMES_IN_FLIGHT);
-        m_frame_resources.pre_frame_command_buffers.resize(m_frame_resources.MAX_FRAMES_IN_FLIGHT);
-        m_frame_resources.post_frame_command_buffers.resize(m_frame_resources.MAX_FRAMES_IN_FLIGHT);
-        m_frame_resources.fences.resize(m_frame_resources.MAX_FRAMES_IN_FLIGHT);
-        m_frame_resources.image_available_semaphores.resize(m_frame_resources.MAX_FRAMES_IN_FLIGHT);
-        m_frame_resources.image_ready_semaphores.resize(m_frame_resources.MAX_FRAMES_IN_FLIGHT);
-        m_frame_resources.layer_render_finished_semaphores.resize(m_frame_resources.MAX_FRAMES_IN_FLIGHT);
-        m_frame_resources.render_finished_semaphores.resize(m_frame_resources.MAX_FRAMES_IN_FLIGHT);
-
-        for (size_t i = 0; i < m_frame_resources.MAX_FRAMES_IN_FLIGHT; ++i) {
+        m_frame_resources.leased_command_buffers.resize(m_context->frames_in_flight());
+        m_frame_resources.worker_pools.resize(m_context->frames_in_flight());
+        m_frame_resources.idle_worker_pools.resize(m_context->frames_in_flight());
+        m_frame_resources.pre_frame_command_buffers.resize(m_context->frames_in_flight());
+        m_frame_resources.post_frame_command_buffers.resize(m_context->frames_in_flight());
+        m_frame_resources.frame_values.resize(m_context->frames_in_flight(), 0);
+        m_frame_resources.image_available_semaphores.resize(m_context->frames_in_flight());
+        m_frame_resources.render_finished_semaphores.resize(m_context->frames_in_flight());
+
+        for (size_t i = 0; i < m_context->frames_in_flight(); ++i) {
             const VkSemaphoreCreateInfo semaphore_info = {
                 .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
                 .pNext = nullptr,
@@ -378,58 +538,42 @@ namespace milg {
             };
 
             for (auto &semaphore :
-                 {&m_frame_resources.image_available_semaphores[i],
-                  &m_frame_resources.layer_render_finished_semaphores[i],
-                  &m_frame_resources.render_finished_semaphores[i], &m_frame_resources.image_ready_semaphores[i]}) {
+                 {&m_frame_resources.image_available_semaphores[i], &m_frame_resources.render_finished_semaphores[i]}) {
                 VK_CHECK(vkCreateSemaphore(m_context->device(), &semaphore_info, nullptr, semaphore));
             }
         }
 
-        const VkFenceCreateInfo fence_info = {
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .pNext = nullptr,
-            .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+        // Frame n signals value n once the device finished it, a slot is free again once its last value is reached
+        const VkSemaphoreTypeCreateInfo semaphore_type_info = {
+            .sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .pNext         = nullptr,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue  = 0,
         };
 
-        for (auto &fence : m_frame_resources.fences) {
-            VK_CHECK(vkCreateFence(m_context->device(), &fence_info, nullptr, &fence));
-        }
-
-        VkCommandPoolCreateInfo command_pool_info = {
-            .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-            .pNext            = nullptr,
-            .flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-            .queueFamilyIndex = m_context->graphics_queue_family_index(),
-        };
-        VK_CHECK(
-            vkCreateCommandPool(m_context->device(), &command_pool_info, nullptr, &m_frame_resources.command_pool));
-
-        VkCommandBufferAllocateInfo command_buffer_info = {
-            .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .pNext              = nullptr,
-            .commandPool        = m_frame_resources.command_pool,
-            .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = static_cast<uint32_t>(m_frame_resources.pre_frame_command_buffers.size()),
+        const VkSemaphoreCreateInfo frame_semaphore_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &semaphore_type_info,
+            .flags = 0,
         };
+        VK_CHECK(vkCreateSemaphore(m_context->device(), &frame_semaphore_info, nullptr,
+                                   &m_frame_resources.frame_semaphore));
 
-        VK_CHECK(vkAllocateCommandBuffers(m_context->device(), &command_buffer_info,
-                                          m_frame_resources.pre_frame_command_buffers.data()));
-
-        command_buffer_info.commandBufferCount =
-            static_cast<uint32_t>(m_frame_resources.post_frame_command_buffers.size());
-        VK_CHECK(vkAllocateCommandBuffers(m_context->device(), &command_buffer_info,
-                                          m_frame_resources.post_frame_command_buffers.data()));
+        for (uint32_t i = 0; i < m_context->frames_in_flight(); ++i) {
+            m_frame_resources.command_pools.push_back(
+                graphics::CommandBufferPool::create(*m_context, m_context->graphics_queue_family_index()));
+        }
     }
 
     void Application::destroy_frame_resources() {
-        for (size_t i = 0; i < m_frame_resources.MAX_FRAMES_IN_FLIGHT; ++i) {
+        for (size_t i = 0; i < m_context->frames_in_flight(); ++i) {
             vkDestroySemaphore(m_context->device(), m_frame_resources.image_available_semaphores[i], nullptr);
-            vkDestroySemaphore(m_context->device(), m_frame_resources.layer_render_finished_semaphores[i], nullptr);
             vkDestroySemaphore(m_context->device(), m_frame_resources.render_finished_semaphores[i], nullptr);
-            vkDestroySemaphore(m_context->device(), m_frame_resources.image_ready_semaphores[i], nullptr);
-            vkDestroyFence(m_context->device(), m_frame_resources.fences[i], nullptr);
         }
+        vkDestroySemaphore(m_context->device(), m_frame_resources.frame_semaphore, nullptr);
 
-        vkDestroyCommandPool(m_context->device(), m_frame_resources.command_pool, nullptr);
+        m_frame_resources.command_pools.clear();
+        m_frame_resources.idle_worker_pools.clear();
+        m_frame_resources.worker_pools.clear();
     }
 } // namespace milg
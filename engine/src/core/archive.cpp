@@ -0,0 +1,123 @@
+#include <milg/core/archive.hpp>
+
+#include <milg/core/logging.hpp>
+
+#include <lz4.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+
+namespace milg {
+    std::shared_ptr<Archive> Archive::create(const std::filesystem::path &path) {
+        auto file = MappedFile::create(path);
+        if (file == nullptr) {
+            MILG_ERROR("Failed to open archive {}", path.string());
+            return nullptr;
+        }
+
+        const auto bytes = file->bytes();
+
+        ArchiveHeader header = {};
+        if (bytes.size() < sizeof(header)) {
+            MILG_ERROR("Archive {} is truncated", path.string());
+            return nullptr;
+        }
+        memcpy(&header, bytes.data(), sizeof(header));
+
+        if (memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || header.version != ARCHIVE_VERSION) {
+            MILG_ERROR("Archive {} has an unsupported format", path.string());
+            return nullptr;
+        }
+
+        const uint64_t index_size = static_cast<uint64_t>(header.entry_count) * sizeof(ArchiveEntry);
+        if (header.index_offset % alignof(ArchiveEntry) != 0 || header.index_offset > bytes.size() ||
+            index_size > bytes.size() - header.index_offset || header.paths_offset > bytes.size()) {
+            MILG_ERROR("Archive {} has a corrupt index", path.string());
+            return nullptr;
+        }
+
+        const auto entries = std::span<const ArchiveEntry>(
+            reinterpret_cast<const ArchiveEntry *>(bytes.data() + header.index_offset), header.entry_count);
+
+        // Lookups and reads trust the index from here on, so every range it points at is checked once up front
+        const uint64_t paths_size = bytes.size() - header.paths_offset;
+        for (const auto &entry : entries) {
+            const bool path_in_bounds =
+                entry.path_offset <= paths_size && entry.path_length <= paths_size - entry.path_offset;
+            const bool data_in_bounds = entry.offset <= bytes.size() && entry.size <= bytes.size() - entry.offset;
+            // LZ4 takes its sizes as int
+            const bool sizes_valid = entry.compression != ArchiveCompression::LZ4 ||
+                                     (entry.size <= INT32_MAX && entry.uncompressed_size <= INT32_MAX);
+
+            if (!path_in_bounds || !data_in_bounds || !sizes_valid) {
+                MILG_ERROR("Archive {} has a corrupt entry {:016x}", path.string(), entry.hash);
+                return nullptr;
+            }
+        }
+
+        auto archive       = std::shared_ptr<Archive>(new Archive());
+        archive->m_path    = path;
+        archive->m_entries = entries;
+        archive->m_paths   = reinterpret_cast<const char *>(bytes.data() + header.paths_offset);
+        archive->m_file    = std::move(file);
+
+        MILG_INFO("Mounted archive {} with {} entries", path.string(), header.entry_count);
+
+        return archive;
+    }
+
+    bool Archive::contains(AssetId id) const {
+        return this->find(id) != nullptr;
+    }
+
+    auto Archive::read(AssetId id, Bytes &buffer) const -> std::optional<ByteView> {
+        const auto *entry = this->find(id);
+        if (entry == nullptr) {
+            return std::nullopt;
+        }
+
+        // Entry ranges were validated when the archive was opened
+        const auto data = m_file->bytes().subspan(entry->offset, entry->size);
+
+        switch (entry->compression) {
+        case ArchiveCompression::NONE:
+            return data;
+        case ArchiveCompression::LZ4: {
+            buffer.resize(entry->uncompressed_size);
+
+            const int size = LZ4_decompress_safe(reinterpret_cast<const char *>(data.data()),
+                                                 reinterpret_cast<char *>(buffer.data()), static_cast<int>(data.size()),
+                                                 static_cast<int>(buffer.size()));
+            if (size < 0 || static_cast<uint64_t>(size) != entry->uncompressed_size) {
+                MILG_ERROR("Failed to decompress {} from archive {}", id.path(), m_path.string());
+                return std::nullopt;
+            }
+
+            return ByteView(buffer);
+        }
+        }
+
+        MILG_ERROR("Entry {} of archive {} uses an unknown compression", id.path(), m_path.string());
+        return std::nullopt;
+    }
+
+    const std::filesystem::path &Archive::path() const {
+        return m_path;
+    }
+
+    const ArchiveEntry *Archive::find(AssetId id) const {
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), id.hash(),
+                                   [](const ArchiveEntry &entry, uint64_t hash) { return entry.hash < hash; });
+
+        for (; it != m_entries.end() && it->hash == id.hash(); ++it) {
+            if (std::string_view(m_paths + it->path_offset, it->path_length) == id.path()) {
+                return &*it;
+            }
+        }
+
+        return nullptr;
+    }
+} // namespace milg
@@ -1,57 +1,597 @@
 #include <milg/core/asset.hpp>
+#include <milg/core/mapped_file.hpp>
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
 namespace milg {
     std::vector<std::filesystem::path>                        AssetStore::search_paths;
+    std::vector<std::shared_ptr<Archive>>                     AssetStore::archives;
     std::map<std::type_index, std::shared_ptr<Asset::Loader>> AssetStore::loaders{
-        {std::type_index(typeid(Bytes)), std::make_shared<Asset::Loader>()},
+        {std::type_index(typeid(Bytes)), std::make_shared<Asset::BytesLoader>()},
         {std::type_index(typeid(nlohmann::json)), std::make_shared<Asset::JsonLoader>()},
     };
-    std::map<std::filesystem::path, std::shared_ptr<void>> AssetStore::assets;
+    IdMap<AssetStore::CachedAsset>                            AssetStore::assets;
+    IdMap<std::shared_ptr<AssetRequest>>                      AssetStore::in_flight;
+    std::deque<std::shared_ptr<AssetRequest>>                 AssetStore::finalize_queue;
+    AssetMemory                                               AssetStore::budget         = {SIZE_MAX, SIZE_MAX};
+    uint64_t                                                  AssetStore::access_counter = 0;
+    std::mutex                                                AssetStore::mutex;
+    std::thread::id                                           AssetStore::main_thread_id = std::this_thread::get_id();
+    std::unique_ptr<FileWatcher>                              AssetStore::watcher        = nullptr;
+    IdMap<AssetId>                                            AssetStore::watched_files;
+    IdMap<uint64_t>                                           AssetStore::versions;
+    jobs::Counter                                             AssetStore::decode_jobs;
+    jobs::Scheduler                                          *AssetStore::scheduler = nullptr;
+    // Defined last so the workers are joined before any of the state above is destroyed
+    std::unique_ptr<jobs::Scheduler> AssetStore::owned_scheduler = nullptr;
 } // namespace milg
 
+namespace {
+    // Watched files are keyed by their absolute path, which is what the watcher reports
+    uint64_t watch_key(const std::filesystem::path &path) {
+        return milg::hash_asset_path(std::filesystem::absolute(path).lexically_normal().generic_string());
+    }
+} // namespace
+
 namespace milg {
-    auto Asset::Loader::load(std::ifstream &stream) -> LoadResult<void> {
-        return std::make_shared<Bytes>(this->read_stream(stream));
+    thread_local std::filesystem::path Asset::Loader::path;
+
+    auto Asset::Loader::load(ByteView data) -> LoadResult<void> {
+        auto decoded = this->decode(data);
+        if (!decoded.has_value()) {
+            return decoded;
+        }
+
+        return this->finalize(*decoded);
     }
 
-    const std::filesystem::path &Asset::Loader::get_current_path() {
-        return this->path;
+    auto Asset::Loader::candidates(const std::filesystem::path &path) const -> std::vector<std::filesystem::path> {
+        return {path};
     }
 
-    Bytes Asset::Loader::read_stream(std::ifstream &stream) {
-        stream.seekg(0, std::ios::end);
+    // Raw byte assets outlive the mapping, so this is the one loader that has to copy
+    auto Asset::Loader::decode(ByteView data) -> LoadResult<void> {
+        return std::make_shared<Bytes>(data.begin(), data.end());
+    }
 
-        auto size = stream.tellg();
-        auto data = std::vector<std::byte>(size);
+    auto Asset::Loader::finalize(const std::shared_ptr<void> &decoded) -> LoadResult<void> {
+        return decoded;
+    }
 
-        stream.seekg(0, std::ios::beg);
-        stream.read(reinterpret_cast<char *>(data.data()), size);
+    bool Asset::Loader::finalize_on_main_thread() const {
+        return false;
+    }
+
+    auto Asset::Loader::measure(const std::shared_ptr<void> &asset) const -> AssetMemory {
+        return {};
+    }
 
-        data.resize(stream.gcount());
+    bool Asset::Loader::reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh) {
+        return false;
+    }
 
-        return data;
+    const std::filesystem::path &Asset::Loader::get_current_path() {
+        return this->path;
     }
 
     void Asset::Loader::set_current_path(const std::filesystem::path &path) {
         this->path = path;
     }
 
-    auto Asset::JsonLoader::load(std::ifstream &stream) -> LoadResult<void> {
-        auto json = std::make_shared<nlohmann::json>(nullptr);
+    bool Asset::BytesLoader::reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh) {
+        std::swap(*std::static_pointer_cast<Bytes>(existing), *std::static_pointer_cast<Bytes>(fresh));
+        return true;
+    }
 
-        stream >> *json;
+    auto Asset::JsonLoader::decode(ByteView data) -> LoadResult<void> {
+        const auto *begin = reinterpret_cast<const char *>(data.data());
 
-        return json;
+        return std::make_shared<nlohmann::json>(nlohmann::json::parse(begin, begin + data.size()));
+    }
+
+    bool Asset::JsonLoader::reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh) {
+        auto &existing_json = *std::static_pointer_cast<nlohmann::json>(existing);
+        auto &fresh_json    = *std::static_pointer_cast<nlohmann::json>(fresh);
+
+        std::swap(existing_json, fresh_json);
+        return true;
+    }
+} // namespace milg
+
+namespace milg {
+    bool AssetRequest::is_ready() const {
+        std::lock_guard lock(this->mutex);
+
+        return this->state == State::DONE;
+    }
+
+    auto AssetRequest::wait() -> LoadResult<void> {
+        const bool on_main_thread = std::this_thread::get_id() == AssetStore::main_thread_id;
+
+        std::unique_lock lock(this->mutex);
+        while (this->state != State::DONE) {
+            if (this->state == State::QUEUED) {
+                // Nobody picked the request up yet, decode it here rather than blocking on the scheduler
+                this->state = State::DECODING;
+                lock.unlock();
+                AssetStore::decode(shared_from_this());
+                lock.lock();
+                continue;
+            }
+
+            if (this->state == State::DECODED && on_main_thread) {
+                lock.unlock();
+                AssetStore::update();
+                lock.lock();
+                continue;
+            }
+
+            this->condition.wait(lock);
+        }
+
+        if (this->exception) {
+            std::rethrow_exception(this->exception);
+        }
+
+        return *this->result;
     }
 } // namespace milg
 
 namespace milg {
     void AssetStore::add_search_path(const std::filesystem::path &path) {
+        std::lock_guard lock(AssetStore::mutex);
         AssetStore::search_paths.push_back(path);
     }
 
+    bool AssetStore::add_archive(const std::filesystem::path &path) {
+        auto archive = Archive::create(path);
+        if (archive == nullptr) {
+            return false;
+        }
+
+        std::lock_guard lock(AssetStore::mutex);
+        AssetStore::archives.push_back(archive);
+
+        return true;
+    }
+
+    void AssetStore::update() {
+        std::vector<std::pair<AssetId, std::type_index>> changed;
+        {
+            std::lock_guard lock(AssetStore::mutex);
+            if (AssetStore::watcher != nullptr) {
+                for (const auto &path : AssetStore::watcher->poll()) {
+                    const auto *id = AssetStore::watched_files.find(watch_key(path));
+                    if (id == nullptr || AssetStore::in_flight.contains(id->hash())) {
+                        continue;
+                    }
+
+                    // Assets nobody holds anymore are simply loaded fresh the next time they're requested
+                    const auto *cached = AssetStore::assets.find(id->hash());
+                    if (cached != nullptr && (cached->strong != nullptr || !cached->weak.expired())) {
+                        changed.emplace_back(*id, cached->type);
+                    }
+                }
+            }
+        }
+
+        for (const auto &[id, type] : changed) {
+            AssetStore::reload(id, type);
+        }
+
+        while (true) {
+            std::shared_ptr<AssetRequest> request = nullptr;
+            {
+                // Pop one at a time, finalizing an asset may wait on (and therefore finalize) other requests
+                std::lock_guard lock(AssetStore::mutex);
+                if (AssetStore::finalize_queue.empty()) {
+                    break;
+                }
+
+                request = AssetStore::finalize_queue.front();
+                AssetStore::finalize_queue.pop_front();
+            }
+
+            AssetStore::finalize(request);
+        }
+
+        // Evicted assets may own GPU resources, so they are only released from the main thread
+        AssetStore::evict();
+    }
+
     void AssetStore::unload_all() {
+        jobs::Scheduler *scheduler = nullptr;
+        {
+            std::lock_guard lock(AssetStore::mutex);
+            scheduler = AssetStore::scheduler;
+        }
+
+        // Decodes still running hold requests and loaders, the scheduler may be shared so only its jobs are awaited
+        if (scheduler != nullptr) {
+            scheduler->wait(AssetStore::decode_jobs);
+        }
+
+        {
+            std::lock_guard lock(AssetStore::mutex);
+            if (AssetStore::scheduler == AssetStore::owned_scheduler.get()) {
+                AssetStore::scheduler = nullptr;
+            }
+        }
+        AssetStore::owned_scheduler.reset();
+
+        std::lock_guard lock(AssetStore::mutex);
+        AssetStore::finalize_queue.clear();
+        AssetStore::in_flight.clear();
         AssetStore::assets.clear();
+        AssetStore::watched_files.clear();
+    }
+
+    void AssetStore::set_memory_budget(const AssetMemory &budget) {
+        std::lock_guard lock(AssetStore::mutex);
+        AssetStore::budget = budget;
+    }
+
+    auto AssetStore::memory_usage() -> std::map<std::type_index, AssetMemory> {
+        std::lock_guard lock(AssetStore::mutex);
+
+        std::map<std::type_index, AssetMemory> usage;
+        AssetStore::assets.for_each([&](uint64_t, const CachedAsset &cached) {
+            if (cached.strong != nullptr) {
+                usage[cached.type].cpu += cached.memory.cpu;
+                usage[cached.type].gpu += cached.memory.gpu;
+            }
+        });
+
+        return usage;
+    }
+
+    void AssetStore::enable_hot_reload() {
+        std::lock_guard lock(AssetStore::mutex);
+        if (AssetStore::watcher != nullptr) {
+            return;
+        }
+
+        AssetStore::watcher = FileWatcher::create();
+        if (AssetStore::watcher == nullptr) {
+            MILG_WARN("Hot reload is not supported on this platform");
+        }
+    }
+
+    uint64_t AssetStore::version(AssetId id) {
+        id.intern();
+        std::lock_guard lock(AssetStore::mutex);
+
+        const auto *version = AssetStore::versions.find(id.hash());
+        return version != nullptr ? *version : 0;
+    }
+
+    auto AssetStore::find(AssetId id) -> std::shared_ptr<void> {
+        id.intern();
+        std::lock_guard lock(AssetStore::mutex);
+        return AssetStore::find_resident(id);
+    }
+
+    auto AssetStore::find_resident(AssetId id) -> std::shared_ptr<void> {
+        auto *cached = AssetStore::assets.find(id.hash());
+        if (cached == nullptr) {
+            return nullptr;
+        }
+
+        // Weak entries come back into the cache if whoever kept them alive still does
+        if (cached->strong == nullptr) {
+            cached->strong = cached->weak.lock();
+        }
+
+        if (cached->strong == nullptr) {
+            AssetStore::assets.erase(id.hash());
+            return nullptr;
+        }
+
+        cached->last_used = ++AssetStore::access_counter;
+
+        return cached->strong;
+    }
+
+    auto AssetStore::request(AssetId id, std::type_index type, bool async) -> std::shared_ptr<AssetRequest> {
+        id.intern();
+        std::lock_guard lock(AssetStore::mutex);
+
+        auto request  = std::make_shared<AssetRequest>();
+        request->id   = id;
+        request->path = id.path();
+        request->type = type;
+
+        if (auto asset = AssetStore::find_resident(id); asset != nullptr) {
+            request->result = asset;
+            request->state  = AssetRequest::State::DONE;
+
+            return request;
+        }
+
+        if (auto *pending = AssetStore::in_flight.find(id.hash()); pending != nullptr) {
+            return *pending;
+        }
+
+        if (auto iter = AssetStore::loaders.find(type); iter != AssetStore::loaders.end()) {
+            request->loader = iter->second;
+        } else {
+            request->result = std::unexpected(asset_load_error::invalid_type);
+            request->state  = AssetRequest::State::DONE;
+
+            return request;
+        }
+
+        AssetStore::in_flight[id.hash()] = request;
+
+        if (async) {
+            AssetStore::submit(request);
+        }
+
+        return request;
+    }
+
+    void AssetStore::reload(AssetId id, std::type_index type) {
+        std::lock_guard lock(AssetStore::mutex);
+
+        auto iter = AssetStore::loaders.find(type);
+        if (iter == AssetStore::loaders.end()) {
+            return;
+        }
+
+        MILG_INFO("Reloading {}", id.path());
+
+        auto request    = std::make_shared<AssetRequest>();
+        request->id     = id;
+        request->path   = id.path();
+        request->type   = type;
+        request->loader = iter->second;
+        request->reload = true;
+
+        AssetStore::in_flight[id.hash()] = request;
+        AssetStore::submit(request);
+    }
+
+    void AssetStore::set_scheduler(jobs::Scheduler *scheduler) {
+        std::lock_guard lock(AssetStore::mutex);
+        AssetStore::scheduler = scheduler;
+    }
+
+    void AssetStore::submit(const std::shared_ptr<AssetRequest> &request) {
+        if (AssetStore::scheduler == nullptr) {
+            AssetStore::owned_scheduler = std::make_unique<jobs::Scheduler>();
+            AssetStore::scheduler       = AssetStore::owned_scheduler.get();
+        }
+
+        AssetStore::scheduler->submit(
+            [request] {
+                {
+                    std::lock_guard lock(request->mutex);
+                    if (request->state != AssetRequest::State::QUEUED) {
+                        return;
+                    }
+                    request->state = AssetRequest::State::DECODING;
+                }
+
+                AssetStore::decode(request);
+            },
+            &AssetStore::decode_jobs);
+    }
+
+    void AssetStore::decode(const std::shared_ptr<AssetRequest> &request) {
+        MILG_DEBUG("Loading {}…", request->path.string());
+
+        std::vector<std::filesystem::path>    search_paths;
+        std::vector<std::shared_ptr<Archive>> archives;
+        {
+            std::lock_guard lock(AssetStore::mutex);
+            search_paths = AssetStore::search_paths;
+            archives     = AssetStore::archives;
+        }
+
+        // A candidate that fails to decode doesn't stop the others, the first exception is only reported when none
+        // of them succeeds
+        bool               found            = false;
+        std::exception_ptr decode_exception = nullptr;
+
+        auto try_decode = [&](const std::filesystem::path &path, ByteView data) {
+            found = true;
+            request->loader->set_current_path(path);
+
+            try {
+                if (auto result = request->loader->decode(data); result.has_value()) {
+                    request->resolved_path = path;
+                    request->file_size     = data.size();
+                    request->decoded       = *result;
+                }
+            } catch (...) {
+                MILG_WARN("Decoding {} failed", path.string());
+                if (decode_exception == nullptr) {
+                    decode_exception = std::current_exception();
+                }
+            }
+
+            return request->decoded != nullptr;
+        };
+
+        try {
+            for (const auto &candidate : request->loader->candidates(request->path)) {
+                // Archives answer from their index, so they are checked before probing the search paths
+                for (const auto &archive : archives) {
+                    Bytes buffer;
+                    auto  data = archive->read(AssetId(candidate), buffer);
+                    if (data.has_value() && try_decode(candidate, *data)) {
+                        break;
+                    }
+                }
+
+                if (request->decoded != nullptr) {
+                    break;
+                }
+
+                for (const auto &search_path : search_paths) {
+                    auto current_path = search_path / candidate;
+                    auto file         = MappedFile::create(current_path);
+                    if (file != nullptr && try_decode(current_path, file->bytes())) {
+                        request->on_disk = true;
+                        break;
+                    }
+                }
+
+                if (request->decoded != nullptr) {
+                    break;
+                }
+            }
+        } catch (...) {
+            AssetStore::complete(request, std::unexpected(asset_load_error::load_failed), std::current_exception());
+            return;
+        }
+
+        if (request->decoded == nullptr) {
+            const auto error = found ? asset_load_error::load_failed : asset_load_error::file_not_found;
+            AssetStore::complete(request, std::unexpected(error), decode_exception);
+            return;
+        }
+
+        // Reloads swap the contents of assets that may be in use, which is only safe between frames
+        const bool main_thread = request->loader->finalize_on_main_thread() || request->reload;
+        if (main_thread && std::this_thread::get_id() != AssetStore::main_thread_id) {
+            {
+                std::lock_guard lock(AssetStore::mutex);
+                std::lock_guard request_lock(request->mutex);
+
+                request->state = AssetRequest::State::DECODED;
+                AssetStore::finalize_queue.push_back(request);
+            }
+            request->condition.notify_all();
+
+            return;
+        }
+
+        AssetStore::finalize(request);
+    }
+
+    void AssetStore::finalize(const std::shared_ptr<AssetRequest> &request) {
+        request->loader->set_current_path(request->resolved_path);
+
+        try {
+            auto result      = request->loader->finalize(request->decoded);
+            request->decoded = nullptr;
+
+            AssetStore::complete(request, result, nullptr);
+        } catch (...) {
+            request->decoded = nullptr;
+
+            AssetStore::complete(request, std::unexpected(asset_load_error::load_failed), std::current_exception());
+        }
+    }
+
+    void AssetStore::complete(const std::shared_ptr<AssetRequest> &request, LoadResult<void> result,
+                              std::exception_ptr exception) {
+        // Holds the previous contents after an in-place reload, released outside the lock
+        std::shared_ptr<void> replaced = nullptr;
+        if (request->reload && result.has_value()) {
+            if (auto existing = AssetStore::find(request->id);
+                existing != nullptr && request->loader->reload(existing, *result)) {
+                replaced = std::exchange(*result, existing);
+            }
+        } else if (request->reload) {
+            MILG_WARN("Failed to reload {}, keeping the previous version", request->id.path());
+        }
+
+        AssetMemory memory = {};
+        if (result.has_value() && *result != nullptr) {
+            memory = request->loader->measure(*result);
+            if (memory.cpu == 0 && memory.gpu == 0) {
+                memory.cpu = request->file_size;
+            }
+        }
+
+        {
+            std::lock_guard lock(AssetStore::mutex);
+            if (result.has_value()) {
+                AssetStore::assets[request->id.hash()] = {
+                    .id        = request->id,
+                    .strong    = *result,
+                    .weak      = *result,
+                    .type      = request->type,
+                    .memory    = memory,
+                    .last_used = ++AssetStore::access_counter,
+                };
+
+                if (request->reload) {
+                    AssetStore::versions[request->id.hash()]++;
+                }
+
+                if (request->on_disk && AssetStore::watcher != nullptr) {
+                    AssetStore::watched_files[watch_key(request->resolved_path)] = request->id;
+                    AssetStore::watcher->watch(request->resolved_path);
+                }
+            }
+            AssetStore::in_flight.erase(request->id.hash());
+        }
+
+        {
+            std::lock_guard lock(request->mutex);
+            request->result    = std::move(result);
+            request->exception = exception;
+            request->state     = AssetRequest::State::DONE;
+        }
+        request->condition.notify_all();
+    }
+
+    void AssetStore::evict() {
+        // Released outside the lock, destroying an asset may drop the last reference to other assets
+        std::vector<std::shared_ptr<void>> released;
+
+        {
+            std::lock_guard lock(AssetStore::mutex);
+
+            // Drop weak entries whose asset is gone so the table doesn't grow with every path ever loaded
+            AssetStore::assets.erase_if(
+                [](uint64_t, const CachedAsset &cached) { return cached.strong == nullptr && cached.weak.expired(); });
+
+            AssetMemory                resident = {};
+            std::vector<CachedAsset *> candidates;
+            AssetStore::assets.for_each([&](uint64_t, CachedAsset &cached) {
+                if (cached.strong != nullptr) {
+                    resident.cpu += cached.memory.cpu;
+                    resident.gpu += cached.memory.gpu;
+                    candidates.push_back(&cached);
+                }
+            });
+
+            if (resident.cpu <= AssetStore::budget.cpu && resident.gpu <= AssetStore::budget.gpu) {
+                return;
+            }
+
+            // Assets only the cache holds go first, evicting anything else doesn't free memory until it's released
+            std::sort(candidates.begin(), candidates.end(), [](const auto &a, const auto &b) {
+                const bool a_shared = a->strong.use_count() > 1;
+                const bool b_shared = b->strong.use_count() > 1;
+
+                return a_shared != b_shared ? b_shared : a->last_used < b->last_used;
+            });
+
+            for (auto *cached : candidates) {
+                if (resident.cpu <= AssetStore::budget.cpu && resident.gpu <= AssetStore::budget.gpu) {
+                    break;
+                }
+
+                if ((resident.cpu <= AssetStore::budget.cpu || cached->memory.cpu == 0) &&
+                    (resident.gpu <= AssetStore::budget.gpu || cached->memory.gpu == 0)) {
+                    continue;
+                }
+
+                MILG_DEBUG("Evicting {} ({} bytes CPU, {} bytes GPU)", cached->id.path(), cached->memory.cpu,
+                           cached->memory.gpu);
+
+                resident.cpu -= cached->memory.cpu;
+                resident.gpu -= cached->memory.gpu;
+                released.push_back(std::move(cached->strong));
+            }
+        }
     }
 } // namespace milg
@@ -0,0 +1,58 @@
+#include <milg/core/asset_id.hpp>
+#include <milg/core/id_map.hpp>
+#include <milg/core/logging.hpp>
+
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    // Interned strings never move or go away, ids keep views into them
+    std::mutex                    intern_mutex;
+    std::deque<std::string>       intern_storage;
+    milg::IdMap<std::string_view> intern_table;
+
+    // Ids only compare hashes, a second path with the same hash would silently resolve to the first asset
+    void check_collision(std::string_view interned, std::string_view path, uint64_t hash) {
+        if (interned != path) {
+            MILG_ERROR("Asset paths {} and {} have the same hash {:016x}", interned, path, hash);
+            throw std::runtime_error("Asset path hash collision");
+        }
+    }
+} // namespace
+
+namespace milg {
+    AssetId::AssetId(const std::filesystem::path &path) {
+        const auto normalized = path.lexically_normal().generic_string();
+        const auto hash       = hash_asset_path(normalized);
+
+        std::lock_guard lock(intern_mutex);
+        if (const auto *interned = intern_table.find(hash); interned != nullptr) {
+            check_collision(*interned, normalized, hash);
+
+            m_hash = hash;
+            m_path = *interned;
+            return;
+        }
+
+        m_hash             = hash;
+        m_path             = intern_storage.emplace_back(normalized);
+        intern_table[hash] = m_path;
+    }
+
+    void AssetId::intern() const {
+        if (!m_literal) {
+            return;
+        }
+
+        std::lock_guard lock(intern_mutex);
+        if (const auto *interned = intern_table.find(m_hash); interned != nullptr) {
+            check_collision(*interned, m_path, m_hash);
+            return;
+        }
+
+        // Literals live as long as the program, their view is interned without a copy
+        intern_table[m_hash] = m_path;
+    }
+} // namespace milg
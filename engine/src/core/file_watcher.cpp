@@ -0,0 +1,88 @@
+#include <milg/core/file_watcher.hpp>
+
+#include <milg/core/logging.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#define MILG_FILE_WATCHER_INOTIFY
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace milg {
+    std::unique_ptr<FileWatcher> FileWatcher::create() {
+#ifdef MILG_FILE_WATCHER_INOTIFY
+        const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            MILG_WARN("Failed to initialize inotify: {}", std::strerror(errno));
+            return nullptr;
+        }
+
+        auto watcher  = std::unique_ptr<FileWatcher>(new FileWatcher());
+        watcher->m_fd = fd;
+
+        return watcher;
+#else
+        return nullptr;
+#endif
+    }
+
+    FileWatcher::~FileWatcher() {
+#ifdef MILG_FILE_WATCHER_INOTIFY
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+#endif
+    }
+
+    void FileWatcher::watch(const std::filesystem::path &path) {
+#ifdef MILG_FILE_WATCHER_INOTIFY
+        const auto directory = std::filesystem::absolute(path).lexically_normal().parent_path();
+
+        // Adding a directory that is already watched returns its existing descriptor
+        const int wd = inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            MILG_WARN("Failed to watch {}: {}", directory.string(), std::strerror(errno));
+            return;
+        }
+
+        m_directories[wd] = directory;
+#endif
+    }
+
+    auto FileWatcher::poll() -> std::vector<std::filesystem::path> {
+        std::vector<std::filesystem::path> changed;
+
+#ifdef MILG_FILE_WATCHER_INOTIFY
+        alignas(inotify_event) std::array<char, 4096> buffer;
+
+        while (true) {
+            const ssize_t length = ::read(m_fd, buffer.data(), buffer.size());
+            if (length <= 0) {
+                break;
+            }
+
+            for (ssize_t offset = 0; offset < length;) {
+                const auto *event = reinterpret_cast<const inotify_event *>(buffer.data() + offset);
+                offset += sizeof(inotify_event) + event->len;
+
+                auto directory = m_directories.find(event->wd);
+                if (event->len == 0 || directory == m_directories.end()) {
+                    continue;
+                }
+
+                auto path = directory->second / event->name;
+                if (std::find(changed.begin(), changed.end(), path) == changed.end()) {
+                    changed.push_back(std::move(path));
+                }
+            }
+        }
+#endif
+
+        return changed;
+    }
+} // namespace milg
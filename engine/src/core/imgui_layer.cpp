@@ -56,9 +56,9 @@ namespace milg {
             .Queue               = context->graphics_queue(),
             .DescriptorPool      = imgui_descriptor_pool,
             .MinImageCount       = 2,
-            .ImageCount          = 2,
+            .ImageCount          = context->frames_in_flight(),
             .MSAASamples         = VK_SAMPLE_COUNT_1_BIT,
-            .PipelineCache       = VK_NULL_HANDLE,
+            .PipelineCache       = context->pipeline_cache(),
             .Subpass             = 0,
             .UseDynamicRendering = VK_TRUE,
             .PipelineRenderingCreateInfo =
@@ -0,0 +1,227 @@
+#include <milg/core/jobs.hpp>
+#include <milg/core/logging.hpp>
+
+#include <algorithm>
+
+namespace milg::jobs {
+    namespace {
+        // Lets a job find its worker's own queue, other threads push to the shared one
+        thread_local const Scheduler *t_scheduler   = nullptr;
+        thread_local uint32_t         t_queue_index = 0;
+    } // namespace
+
+    bool Counter::is_done() {
+        std::lock_guard lock(m_mutex);
+        return m_count == 0;
+    }
+
+    Scheduler::Scheduler(uint32_t thread_count) {
+        if (thread_count == 0) {
+            thread_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+        }
+
+        for (uint32_t i = 0; i < thread_count + 1; ++i) {
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+
+        for (uint32_t i = 0; i < thread_count; ++i) {
+            m_threads.emplace_back([this, i](std::stop_token stop_token) {
+                worker(stop_token, i);
+            });
+        }
+    }
+
+    Scheduler::~Scheduler() {
+        for (auto &thread : m_threads) {
+            thread.request_stop();
+        }
+        m_sleep_condition.notify_all();
+
+        // Workers only stop once nothing is queued, jobs pushed while they exit end up on the shared queue
+        m_threads.clear();
+
+        Job job;
+        while (try_pop(job)) {
+            run(job, nullptr);
+        }
+    }
+
+    void Scheduler::submit(Job job, Counter *counter) {
+        if (counter == nullptr) {
+            push(std::move(job));
+            return;
+        }
+
+        {
+            std::lock_guard lock(counter->m_mutex);
+            counter->m_count++;
+        }
+
+        push([this, job = std::move(job), counter]() mutable {
+            run(job, counter);
+        });
+    }
+
+    void Scheduler::submit_after(Counter &dependency, Job job, Counter *counter) {
+        if (counter != nullptr) {
+            std::lock_guard lock(counter->m_mutex);
+            counter->m_count++;
+        }
+
+        Job continuation = [this, job = std::move(job), counter]() mutable {
+            run(job, counter);
+        };
+
+        {
+            // The count only drops under this lock, so the continuation is either stored or the dependency is done
+            std::lock_guard lock(dependency.m_mutex);
+            if (dependency.m_count != 0) {
+                dependency.m_continuations.push_back(std::move(continuation));
+                return;
+            }
+        }
+
+        push(std::move(continuation));
+    }
+
+    void Scheduler::wait(Counter &counter) {
+        while (!counter.is_done()) {
+            Job job;
+            if (try_pop(job)) {
+                run(job, nullptr);
+                continue;
+            }
+
+            // finish() notifies once the count reaches zero, push() once there is something to help with
+            std::unique_lock lock(m_sleep_mutex);
+            m_sleep_condition.wait(lock, [this, &counter] {
+                return m_queued > 0 || counter.is_done();
+            });
+        }
+
+        std::exception_ptr exception = nullptr;
+        {
+            std::lock_guard lock(counter.m_mutex);
+            std::swap(exception, counter.m_exception);
+        }
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    uint32_t Scheduler::thread_count() const {
+        return static_cast<uint32_t>(m_threads.size());
+    }
+
+    void Scheduler::push(Job job) {
+        const uint32_t index = t_scheduler == this ? t_queue_index : thread_count();
+
+        // Counted before it is visible so a thief never takes the count below zero
+        m_queued++;
+        {
+            std::lock_guard lock(m_queues[index]->mutex);
+            m_queues[index]->jobs.push_back(std::move(job));
+        }
+
+        // Taking the lock orders the push against a worker that just checked the count and is about to sleep
+        {
+            std::lock_guard lock(m_sleep_mutex);
+        }
+        m_sleep_condition.notify_one();
+    }
+
+    bool Scheduler::try_pop(Job &job) {
+        const uint32_t own = t_scheduler == this ? t_queue_index : thread_count();
+        {
+            // Newest first on the own queue keeps the data of the job that pushed it warm in cache
+            auto           &queue = *m_queues[own];
+            std::lock_guard lock(queue.mutex);
+            if (!queue.jobs.empty()) {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+                m_queued--;
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < m_queues.size(); ++i) {
+            auto           &queue = *m_queues[(own + i) % m_queues.size()];
+            std::lock_guard lock(queue.mutex);
+            if (!queue.jobs.empty()) {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+                m_queued--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void Scheduler::run(Job &job, Counter *counter) {
+        // Jobs without a counter have nobody to report to, their exceptions are only logged
+        try {
+            job();
+        } catch (...) {
+            if (counter == nullptr) {
+                MILG_ERROR("Job without a counter threw an exception");
+            } else {
+                std::lock_guard lock(counter->m_mutex);
+                if (!counter->m_exception) {
+                    counter->m_exception = std::current_exception();
+                }
+            }
+        }
+
+        finish(counter);
+    }
+
+    void Scheduler::finish(Counter *counter) {
+        if (counter == nullptr) {
+            return;
+        }
+
+        std::vector<Job> continuations;
+        bool             done = false;
+        {
+            std::lock_guard lock(counter->m_mutex);
+            if (--counter->m_count == 0) {
+                continuations.swap(counter->m_continuations);
+                done = true;
+            }
+        }
+
+        // Wakes the threads waiting on the counter, taking the lock orders this against one about to sleep
+        if (done) {
+            {
+                std::lock_guard lock(m_sleep_mutex);
+            }
+            m_sleep_condition.notify_all();
+        }
+
+        // The counter may be gone once its lock is released, only the moved out continuations are used from here on
+        for (auto &continuation : continuations) {
+            push(std::move(continuation));
+        }
+    }
+
+    void Scheduler::worker(std::stop_token stop_token, uint32_t index) {
+        t_scheduler   = this;
+        t_queue_index = index;
+
+        while (true) {
+            Job job;
+            if (try_pop(job)) {
+                run(job, nullptr);
+                continue;
+            }
+
+            std::unique_lock lock(m_sleep_mutex);
+            if (!m_sleep_condition.wait(lock, stop_token, [this] {
+                    return m_queued > 0;
+                })) {
+                return;
+            }
+        }
+    }
+} // namespace milg::jobs
@@ -0,0 +1,86 @@
+#include <milg/core/mapped_file.hpp>
+
+#include <milg/core/logging.hpp>
+
+#include <fstream>
+
+#ifdef __linux__
+#define MILG_MAPPED_FILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace milg {
+    std::unique_ptr<MappedFile> MappedFile::create(const std::filesystem::path &path) {
+        auto file = std::unique_ptr<MappedFile>(new MappedFile());
+
+#ifdef MILG_MAPPED_FILE_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        struct stat info = {};
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            ::close(fd);
+            return nullptr;
+        }
+
+        // Empty files can't be mapped, they are represented by an empty view
+        if (info.st_size > 0) {
+            void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                // Loaders read the whole file front to back, so ask for aggressive readahead
+                madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+                file->m_data   = static_cast<const std::byte *>(data);
+                file->m_size   = static_cast<size_t>(info.st_size);
+                file->m_mapped = true;
+            } else {
+                MILG_WARN("Failed to map {}, reading it instead", path.string());
+            }
+        }
+
+        ::close(fd);
+
+        if (file->m_mapped || info.st_size == 0) {
+            return file;
+        }
+#endif
+
+        std::ifstream stream(path, std::ios::binary | std::ios::in | std::ios::ate);
+        if (!stream.is_open()) {
+            return nullptr;
+        }
+
+        const auto size = stream.tellg();
+        file->m_buffer.resize(static_cast<size_t>(size));
+
+        stream.seekg(0, std::ios::beg);
+        stream.read(reinterpret_cast<char *>(file->m_buffer.data()), size);
+        file->m_buffer.resize(static_cast<size_t>(stream.gcount()));
+
+        file->m_data = file->m_buffer.data();
+        file->m_size = file->m_buffer.size();
+
+        return file;
+    }
+
+    MappedFile::~MappedFile() {
+#ifdef MILG_MAPPED_FILE_MMAP
+        if (m_mapped) {
+            munmap(const_cast<std::byte *>(m_data), m_size);
+        }
+#endif
+    }
+
+    ByteView MappedFile::bytes() const {
+        return {m_data, m_size};
+    }
+
+    size_t MappedFile::size() const {
+        return m_size;
+    }
+} // namespace milg
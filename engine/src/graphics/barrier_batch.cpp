@@ -0,0 +1,139 @@
+#include <milg/graphics/barrier_batch.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace milg::graphics {
+    namespace {
+        const VkAccessFlags2 WRITE_ACCESS =
+            VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT |
+            VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+        struct LayoutUsage {
+            VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+            VkAccessFlags2        access = VK_ACCESS_2_NONE;
+        };
+
+        // What an image in the layout can be used for
+        LayoutUsage layout_usage(VkImageLayout layout) {
+            switch (layout) {
+            case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+                return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT};
+            case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+                return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_2_SHADER_SAMPLED_READ_BIT};
+            case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+                return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT};
+            case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+                return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT};
+            default:
+                // GENERAL and anything else says nothing about how the image is used
+                return {VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                        VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT};
+            }
+        }
+
+        // Reads of the old layout only have to finish, writes also have to be made available
+        LayoutUsage source_usage(VkImageLayout layout) {
+            if (layout == VK_IMAGE_LAYOUT_UNDEFINED || layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
+                // Whatever handed the image over signalled a semaphore, waiting on it doesn't need a cache flush
+                return {VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_NONE};
+            }
+
+            LayoutUsage usage = layout_usage(layout);
+            usage.access &= WRITE_ACCESS;
+            return usage;
+        }
+
+        LayoutUsage destination_usage(VkImageLayout layout) {
+            if (layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
+                // Presenting waits on a semaphore signalled after the barrier
+                return {};
+            }
+
+            return layout_usage(layout);
+        }
+
+        bool is_read_only(VkImageLayout layout) {
+            return layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ||
+                   layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL || layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        }
+    } // namespace
+
+    void BarrierBatch::transition(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout,
+                                  uint32_t mip_levels) {
+        auto existing = std::find_if(m_barriers.begin(), m_barriers.end(), [image](const auto &barrier) {
+            return barrier.image == image;
+        });
+        if (existing != m_barriers.end()) {
+            // Nothing can use the image between two barriers of one batch, so only the final layout matters
+            const LayoutUsage dst = destination_usage(new_layout);
+
+            existing->newLayout     = new_layout;
+            existing->dstStageMask  = dst.stages;
+            existing->dstAccessMask = dst.access;
+            return;
+        }
+
+        if (old_layout == new_layout && is_read_only(old_layout)) {
+            return;
+        }
+
+        const LayoutUsage src = source_usage(old_layout);
+        const LayoutUsage dst = destination_usage(new_layout);
+
+        m_barriers.push_back({
+            .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .pNext               = nullptr,
+            .srcStageMask        = src.stages,
+            .srcAccessMask       = src.access,
+            .dstStageMask        = dst.stages,
+            .dstAccessMask       = dst.access,
+            .oldLayout           = old_layout,
+            .newLayout           = new_layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image               = image,
+            .subresourceRange    = {.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                                    .baseMipLevel   = 0,
+                                    .levelCount     = mip_levels,
+                                    .baseArrayLayer = 0,
+                                    .layerCount     = 1},
+        });
+    }
+
+    void BarrierBatch::add(const VkImageMemoryBarrier2 &barrier) {
+        m_barriers.push_back(barrier);
+    }
+
+    void BarrierBatch::flush(const VulkanContext &context, VkCommandBuffer command_buffer) {
+        if (m_barriers.empty()) {
+            return;
+        }
+
+        const VkDependencyInfo dependency_info = {
+            .sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .pNext                    = nullptr,
+            .dependencyFlags          = 0,
+            .memoryBarrierCount       = 0,
+            .pMemoryBarriers          = nullptr,
+            .bufferMemoryBarrierCount = 0,
+            .pBufferMemoryBarriers    = nullptr,
+            .imageMemoryBarrierCount  = static_cast<uint32_t>(m_barriers.size()),
+            .pImageMemoryBarriers     = m_barriers.data(),
+        };
+
+        context.device_table().vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+        m_barriers.clear();
+    }
+
+    bool BarrierBatch::empty() const {
+        return m_barriers.empty();
+    }
+
+    uint32_t BarrierBatch::size() const {
+        return static_cast<uint32_t>(m_barriers.size());
+    }
+} // namespace milg::graphics
@@ -41,6 +41,14 @@ namespace milg::graphics {
         buffer->m_allocation_info = allocation_info;
         buffer->m_usage_flags     = create_info.usage_flags;
 
+        if (create_info.usage_flags & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+            buffer->m_descriptor_index = context->descriptor_heap().allocate_buffer({
+                .buffer = buffer_handle,
+                .offset = 0,
+                .range  = VK_WHOLE_SIZE,
+            });
+        }
+
         return buffer;
     }
 
@@ -64,7 +72,12 @@ namespace milg::graphics {
         return m_usage_flags;
     }
 
+    uint32_t Buffer::descriptor_index() const {
+        return m_descriptor_index;
+    }
+
     Buffer::~Buffer() {
+        m_context->descriptor_heap().free_buffer(m_descriptor_index);
         vmaDestroyBuffer(m_context->allocator(), m_handle, m_allocation);
     }
 
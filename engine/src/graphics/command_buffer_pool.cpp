@@ -0,0 +1,58 @@
+#include <milg/graphics/command_buffer_pool.hpp>
+
+#include <milg/core/logging.hpp>
+
+namespace milg::graphics {
+    std::unique_ptr<CommandBufferPool> CommandBufferPool::create(const VulkanContext &context,
+                                                                 uint32_t             queue_family_index) {
+        auto pool = std::unique_ptr<CommandBufferPool>(new CommandBufferPool(context));
+
+        // Buffers are never reset individually, which lets the driver skip per buffer bookkeeping
+        const VkCommandPoolCreateInfo command_pool_info = {
+            .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext            = nullptr,
+            .flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = queue_family_index,
+        };
+        VK_CHECK(context.device_table().vkCreateCommandPool(context.device(), &command_pool_info, nullptr,
+                                                            &pool->m_pool));
+
+        return pool;
+    }
+
+    CommandBufferPool::CommandBufferPool(const VulkanContext &context) : m_context(context) {
+    }
+
+    CommandBufferPool::~CommandBufferPool() {
+        // Destroying the pool frees its buffers
+        m_context.device_table().vkDestroyCommandPool(m_context.device(), m_pool, nullptr);
+    }
+
+    VkCommandBuffer CommandBufferPool::acquire() {
+        if (m_acquired == m_buffers.size()) {
+            const VkCommandBufferAllocateInfo command_buffer_info = {
+                .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .pNext              = nullptr,
+                .commandPool        = m_pool,
+                .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+
+            VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+            VK_CHECK(m_context.device_table().vkAllocateCommandBuffers(m_context.device(), &command_buffer_info,
+                                                                       &command_buffer));
+            m_buffers.push_back(command_buffer);
+        }
+
+        return m_buffers[m_acquired++];
+    }
+
+    void CommandBufferPool::reset() {
+        VK_CHECK(m_context.device_table().vkResetCommandPool(m_context.device(), m_pool, 0));
+        m_acquired = 0;
+    }
+
+    uint32_t CommandBufferPool::allocated_count() const {
+        return static_cast<uint32_t>(m_buffers.size());
+    }
+} // namespace milg::graphics
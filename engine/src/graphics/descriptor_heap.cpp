@@ -0,0 +1,285 @@
+#include <milg/graphics/descriptor_heap.hpp>
+
+#include <milg/core/logging.hpp>
+
+#include <algorithm>
+#include <utility>
+
+namespace milg::graphics {
+    DescriptorHeap::DescriptorHeap(const VulkanContext &context) : m_context(context) {
+    }
+
+    std::unique_ptr<DescriptorHeap> DescriptorHeap::create(const VulkanContext            &context,
+                                                           const DescriptorHeapCreateInfo &create_info) {
+        VkPhysicalDeviceVulkan12Properties limits = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES,
+            .pNext = nullptr,
+        };
+        VkPhysicalDeviceProperties2 properties = {
+            .sType      = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext      = &limits,
+            .properties = {},
+        };
+        vkGetPhysicalDeviceProperties2(context.physical_device(), &properties);
+
+        // Sprite instances store texture slots in 16 bits
+        const uint32_t texture_count = std::min({
+            create_info.texture_count,
+            static_cast<uint32_t>(UINT16_MAX),
+            limits.maxDescriptorSetUpdateAfterBindSampledImages,
+            limits.maxDescriptorSetUpdateAfterBindSamplers,
+            limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+        });
+        const uint32_t storage_image_count = std::min({
+            create_info.storage_image_count,
+            limits.maxDescriptorSetUpdateAfterBindStorageImages,
+            limits.maxPerStageDescriptorUpdateAfterBindStorageImages,
+        });
+        const uint32_t buffer_count = std::min({
+            create_info.buffer_count,
+            limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+            limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+        });
+        MILG_INFO("Creating descriptor heap with {} textures, {} storage images and {} buffers", texture_count,
+                  storage_image_count, buffer_count);
+
+        auto heap = std::unique_ptr<DescriptorHeap>(new DescriptorHeap(context));
+        heap->m_retired_resources.resize(context.frames_in_flight());
+
+        heap->m_arrays[TEXTURE_BINDING].type           = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        heap->m_arrays[TEXTURE_BINDING].capacity       = texture_count;
+        heap->m_arrays[STORAGE_IMAGE_BINDING].type     = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        heap->m_arrays[STORAGE_IMAGE_BINDING].capacity = storage_image_count;
+        heap->m_arrays[BUFFER_BINDING].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        heap->m_arrays[BUFFER_BINDING].capacity        = buffer_count;
+
+        std::array<VkDescriptorPoolSize, 3>         pool_sizes    = {};
+        std::array<VkDescriptorSetLayoutBinding, 3> bindings      = {};
+        std::array<VkDescriptorBindingFlags, 3>     binding_flags = {};
+        for (uint32_t binding = 0; binding < heap->m_arrays.size(); binding++) {
+            auto &array = heap->m_arrays[binding];
+            array.retired.resize(context.frames_in_flight());
+
+            pool_sizes[binding] = {
+                .type            = array.type,
+                .descriptorCount = array.capacity,
+            };
+            bindings[binding] = {
+                .binding            = binding,
+                .descriptorType     = array.type,
+                .descriptorCount    = array.capacity,
+                .stageFlags         = VK_SHADER_STAGE_ALL,
+                .pImmutableSamplers = nullptr,
+            };
+            // Slots that were never written or whose resource is gone are fine as long as no shader reads them
+            binding_flags[binding] =
+                VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+        }
+
+        const VkDescriptorPoolCreateInfo pool_info = {
+            .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .pNext         = nullptr,
+            .flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+            .maxSets       = 1,
+            .poolSizeCount = pool_sizes.size(),
+            .pPoolSizes    = pool_sizes.data(),
+        };
+
+        VK_CHECK(context.device_table().vkCreateDescriptorPool(context.device(), &pool_info, nullptr, &heap->m_pool));
+
+        const VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {
+            .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+            .pNext         = nullptr,
+            .bindingCount  = binding_flags.size(),
+            .pBindingFlags = binding_flags.data(),
+        };
+
+        const VkDescriptorSetLayoutCreateInfo layout_info = {
+            .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .pNext        = &binding_flags_info,
+            .flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+            .bindingCount = bindings.size(),
+            .pBindings    = bindings.data(),
+        };
+
+        VK_CHECK(context.device_table().vkCreateDescriptorSetLayout(context.device(), &layout_info, nullptr,
+                                                                    &heap->m_layout));
+
+        const VkDescriptorSetAllocateInfo set_info = {
+            .sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .pNext              = nullptr,
+            .descriptorPool     = heap->m_pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts        = &heap->m_layout,
+        };
+
+        VK_CHECK(context.device_table().vkAllocateDescriptorSets(context.device(), &set_info, &heap->m_set));
+
+        return heap;
+    }
+
+    DescriptorHeap::~DescriptorHeap() {
+        for (auto &resources : m_retired_resources) {
+            for (auto &destroy : resources) {
+                destroy();
+            }
+        }
+
+        m_context.device_table().vkDestroyDescriptorPool(m_context.device(), m_pool, nullptr);
+        m_context.device_table().vkDestroyDescriptorSetLayout(m_context.device(), m_layout, nullptr);
+    }
+
+    uint32_t DescriptorHeap::allocate_texture(const VkDescriptorImageInfo &image_info) {
+        const uint32_t index = this->allocate(TEXTURE_BINDING);
+        if (index != INVALID_INDEX) {
+            this->write(TEXTURE_BINDING, index, &image_info, nullptr);
+        }
+
+        return index;
+    }
+
+    void DescriptorHeap::write_texture(uint32_t index, const VkDescriptorImageInfo &image_info) {
+        this->write(TEXTURE_BINDING, index, &image_info, nullptr);
+    }
+
+    void DescriptorHeap::free_texture(uint32_t index) {
+        this->retire(TEXTURE_BINDING, index);
+    }
+
+    uint32_t DescriptorHeap::allocate_storage_image(const VkDescriptorImageInfo &image_info) {
+        const uint32_t index = this->allocate(STORAGE_IMAGE_BINDING);
+        if (index != INVALID_INDEX) {
+            this->write(STORAGE_IMAGE_BINDING, index, &image_info, nullptr);
+        }
+
+        return index;
+    }
+
+    void DescriptorHeap::write_storage_image(uint32_t index, const VkDescriptorImageInfo &image_info) {
+        this->write(STORAGE_IMAGE_BINDING, index, &image_info, nullptr);
+    }
+
+    void DescriptorHeap::free_storage_image(uint32_t index) {
+        this->retire(STORAGE_IMAGE_BINDING, index);
+    }
+
+    uint32_t DescriptorHeap::allocate_buffer(const VkDescriptorBufferInfo &buffer_info) {
+        const uint32_t index = this->allocate(BUFFER_BINDING);
+        if (index != INVALID_INDEX) {
+            this->write(BUFFER_BINDING, index, nullptr, &buffer_info);
+        }
+
+        return index;
+    }
+
+    void DescriptorHeap::write_buffer(uint32_t index, const VkDescriptorBufferInfo &buffer_info) {
+        this->write(BUFFER_BINDING, index, nullptr, &buffer_info);
+    }
+
+    void DescriptorHeap::free_buffer(uint32_t index) {
+        this->retire(BUFFER_BINDING, index);
+    }
+
+    void DescriptorHeap::retire_resource(std::function<void()> destroy) {
+        std::lock_guard lock(m_mutex);
+        m_retired_resources[m_frame_index].push_back(std::move(destroy));
+    }
+
+    void DescriptorHeap::release_retired(uint32_t frame_index) {
+        std::vector<std::function<void()>> resources;
+        {
+            std::lock_guard lock(m_mutex);
+            m_frame_index = frame_index;
+
+            for (auto &array : m_arrays) {
+                auto &retired = array.retired[frame_index];
+                array.free.insert(array.free.end(), retired.begin(), retired.end());
+                retired.clear();
+            }
+
+            resources.swap(m_retired_resources[frame_index]);
+        }
+
+        // Outside the lock, destroying a resource may free further slots
+        for (auto &destroy : resources) {
+            destroy();
+        }
+    }
+
+    VkDescriptorSetLayout DescriptorHeap::layout() const {
+        return m_layout;
+    }
+
+    VkDescriptorSet DescriptorHeap::set() const {
+        return m_set;
+    }
+
+    uint32_t DescriptorHeap::texture_count() const {
+        return this->count(TEXTURE_BINDING);
+    }
+
+    uint32_t DescriptorHeap::storage_image_count() const {
+        return this->count(STORAGE_IMAGE_BINDING);
+    }
+
+    uint32_t DescriptorHeap::buffer_count() const {
+        return this->count(BUFFER_BINDING);
+    }
+
+    uint32_t DescriptorHeap::allocate(uint32_t binding) {
+        std::lock_guard lock(m_mutex);
+        auto           &array = m_arrays[binding];
+
+        uint32_t index = INVALID_INDEX;
+        if (!array.free.empty()) {
+            index = array.free.back();
+            array.free.pop_back();
+        } else if (array.next < array.capacity) {
+            index = array.next++;
+        } else {
+            MILG_ERROR("DescriptorHeap::allocate: All {} {} slots are in use", array.capacity,
+                       string_VkDescriptorType(array.type));
+            return INVALID_INDEX;
+        }
+
+        array.count++;
+
+        return index;
+    }
+
+    void DescriptorHeap::write(uint32_t binding, uint32_t index, const VkDescriptorImageInfo *image_info,
+                               const VkDescriptorBufferInfo *buffer_info) {
+        const VkWriteDescriptorSet write = {
+            .sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext            = nullptr,
+            .dstSet           = m_set,
+            .dstBinding       = binding,
+            .dstArrayElement  = index,
+            .descriptorCount  = 1,
+            .descriptorType   = m_arrays[binding].type,
+            .pImageInfo       = image_info,
+            .pBufferInfo      = buffer_info,
+            .pTexelBufferView = nullptr,
+        };
+
+        std::lock_guard lock(m_mutex);
+        m_context.device_table().vkUpdateDescriptorSets(m_context.device(), 1, &write, 0, nullptr);
+    }
+
+    void DescriptorHeap::retire(uint32_t binding, uint32_t index) {
+        if (index == INVALID_INDEX) {
+            return;
+        }
+
+        // Frames recorded up to now may still use the slot, it waits until this frame slot comes around again
+        std::lock_guard lock(m_mutex);
+        m_arrays[binding].retired[m_frame_index].push_back(index);
+        m_arrays[binding].count--;
+    }
+
+    uint32_t DescriptorHeap::count(uint32_t binding) const {
+        std::lock_guard lock(m_mutex);
+        return m_arrays[binding].count;
+    }
+} // namespace milg::graphics
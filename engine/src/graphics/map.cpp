@@ -5,6 +5,8 @@
 
 #include <stb_image.h>
 
+#include <utility>
+
 namespace milg {
     Tileset::Tileset(const std::shared_ptr<graphics::Texture> &texture, const glm::ivec2 &tile_size,
                      std::size_t columns, std::size_t margin, std::size_t spacing)
@@ -146,8 +148,9 @@ namespace milg {
                             offset.x + (j * tile_size.x),
                             offset.y + (i * tile_size.y),
                         },
-                     .size = tile_size,
-                     .uvs  = tileset->get_uv(gid),
+                     .size          = tile_size,
+                     .uvs           = tileset->get_uv(gid),
+                     .texture_index = static_cast<float>(tileset->get_texture()->descriptor_index()),
                 };
 
                 tiles.push_back(std::make_shared<Tile>(gid, sprite, tileset));
@@ -193,12 +196,24 @@ namespace milg {
         return objects;
     }
 
-    auto Map::Loader::load(std::ifstream &stream) -> LoadResult<void> {
-        auto                                  json = nlohmann::json::parse(stream);
-        std::vector<std::shared_ptr<Tileset>> tilesets;
-        std::map<Gid, std::weak_ptr<Tileset>> tileset_gid_map;
+    struct MapData {
+        struct TilesetData {
+            Gid                             first_gid;
+            std::shared_ptr<nlohmann::json> json;
+            AssetFuture<graphics::Texture>  texture;
+        };
+
+        nlohmann::json           json;
+        std::vector<TilesetData> tilesets;
+    };
 
-        for (auto &tileset_obj : json["tilesets"]) {
+    auto Map::Loader::decode(ByteView data) -> LoadResult<void> {
+        const auto *begin = reinterpret_cast<const char *>(data.data());
+
+        auto map  = std::make_shared<MapData>();
+        map->json = nlohmann::json::parse(begin, begin + data.size());
+
+        for (auto &tileset_obj : map->json["tilesets"]) {
             auto first_gid    = tileset_obj.at("firstgid").get<Gid>();
             auto source       = tileset_obj.at("source").get<std::string>();
             auto loader_path  = this->get_current_path();
@@ -208,22 +223,43 @@ namespace milg {
             }
             auto texture_path =
                 loader_path.parent_path().parent_path() / "textures" / (*tileset_json)->at("image").get<std::string>();
-            auto texture = AssetStore::load<graphics::Texture>(texture_path);
+
+            // Textures decode in parallel with the rest of the map, they are only waited on in finalize
+            map->tilesets.push_back({
+                .first_gid = first_gid,
+                .json      = *tileset_json,
+                .texture   = AssetStore::load_async<graphics::Texture>(texture_path),
+            });
+        }
+
+        return map;
+    }
+
+    auto Map::Loader::finalize(const std::shared_ptr<void> &decoded) -> LoadResult<void> {
+        auto                                  map  = std::static_pointer_cast<MapData>(decoded);
+        auto                                 &json = map->json;
+        std::vector<std::shared_ptr<Tileset>> tilesets;
+        std::map<Gid, std::weak_ptr<Tileset>> tileset_gid_map;
+
+        for (auto &tileset_data : map->tilesets) {
+            auto texture = tileset_data.texture.get();
             if (!texture.has_value()) {
                 return std::unexpected(texture.error());
             }
-            auto tileset = std::make_shared<Tileset>(*texture,
-                                                     glm::ivec2{
-                                                         (*tileset_json)->at("tilewidth").get<int>(),
-                                                         (*tileset_json)->at("tileheight").get<int>(),
-                                                     },
-                                                     (*tileset_json)->at("columns").get<std::size_t>(),
-                                                     (*tileset_json)->at("spacing").get<std::size_t>(),
-                                                     (*tileset_json)->at("margin").get<std::size_t>());
+            auto &tileset_json = tileset_data.json;
+            auto  tileset      = std::make_shared<Tileset>(*texture,
+                                                           glm::ivec2{
+                                                               tileset_json->at("tilewidth").get<int>(),
+                                                               tileset_json->at("tileheight").get<int>(),
+                                                           },
+                                                           tileset_json->at("columns").get<std::size_t>(),
+                                                           tileset_json->at("spacing").get<std::size_t>(),
+                                                           tileset_json->at("margin").get<std::size_t>());
 
             tilesets.push_back(tileset);
 
-            auto tile_count = (*tileset_json)->at("tilecount").get<std::size_t>();
+            auto first_gid  = tileset_data.first_gid;
+            auto tile_count = tileset_json->at("tilecount").get<std::size_t>();
 
             for (auto i = first_gid; i <= first_gid + tile_count; i++) {
                 tileset_gid_map[i] = tileset;
@@ -264,4 +300,14 @@ namespace milg {
             },
             tile_size, tiles, objects);
     }
+
+    // Tilesets hold textures, so the map is built once they are finalized on the main thread
+    bool Map::Loader::finalize_on_main_thread() const {
+        return true;
+    }
+
+    bool Map::Loader::reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh) {
+        std::swap(*std::static_pointer_cast<Map>(existing), *std::static_pointer_cast<Map>(fresh));
+        return true;
+    }
 } // namespace milg
@@ -2,6 +2,7 @@
 
 #include <milg/core/asset.hpp>
 #include <milg/core/logging.hpp>
+#include <milg/graphics/descriptor_heap.hpp>
 
 #include <array>
 #include <cstdint>
@@ -34,7 +35,8 @@ namespace milg::graphics {
             }
         }
 
-        std::array<VkQueryPool, 2> query_pools = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        // One pool per frame slot, a slot's results are read back once the frame that wrote them has finished
+        std::vector<VkQueryPool> query_pools;
         if (supports_timestamps) {
             MILG_INFO("Timestamps supported, enabling frame timings");
             MILG_INFO("Timestamp period: {}", context->device_limits().timestampPeriod);
@@ -48,39 +50,17 @@ namespace milg::graphics {
                 .pipelineStatistics = 0,
             };
 
-            VK_CHECK(context->device_table().vkCreateQueryPool(context->device(), &query_pool_info, nullptr,
-                                                               &query_pools[0]));
-            VK_CHECK(context->device_table().vkCreateQueryPool(context->device(), &query_pool_info, nullptr,
-                                                               &query_pools[1]));
-
-            context->device_table().vkResetQueryPool(context->device(), query_pools[0], 0, query_pool_info.queryCount);
-            context->device_table().vkResetQueryPool(context->device(), query_pools[1], 0, query_pool_info.queryCount);
+            query_pools.resize(context->frames_in_flight());
+            for (auto &query_pool : query_pools) {
+                VK_CHECK(context->device_table().vkCreateQueryPool(context->device(), &query_pool_info, nullptr,
+                                                                   &query_pool));
+                context->device_table().vkResetQueryPool(context->device(), query_pool, 0, query_pool_info.queryCount);
+            }
         }
 
-        std::array<VkDescriptorPoolSize, 4> poolSizes = {
-            VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000},
-            VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
-            VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000},
-            VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000},
-        };
-
-        const VkDescriptorPoolCreateInfo poolInfo = {
-            .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-            .pNext         = nullptr,
-            .flags         = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-            .maxSets       = 1000,
-            .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
-            .pPoolSizes    = poolSizes.data(),
-        };
-
-        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
-        VK_CHECK(
-            context->device_table().vkCreateDescriptorPool(context->device(), &poolInfo, nullptr, &descriptorPool));
-
-        auto factory                      = std::shared_ptr<PipelineFactory>(new PipelineFactory());
-        factory->m_context                = context;
-        factory->m_global_descriptor_pool = descriptorPool;
-        factory->m_query_pools            = query_pools;
+        auto factory           = std::shared_ptr<PipelineFactory>(new PipelineFactory());
+        factory->m_context     = context;
+        factory->m_query_pools = query_pools;
 
         return factory;
     }
@@ -89,14 +69,10 @@ namespace milg::graphics {
         for (auto &pipeline : m_pipelines) {
             m_context->device_table().vkDestroyPipeline(m_context->device(), pipeline.second.pipeline, nullptr);
             m_context->device_table().vkDestroyPipelineLayout(m_context->device(), pipeline.second.layout, nullptr);
-            m_context->device_table().vkDestroyDescriptorSetLayout(m_context->device(), pipeline.second.set_layout,
-                                                                   nullptr);
         }
-        m_context->device_table().vkDestroyDescriptorPool(m_context->device(), m_global_descriptor_pool, nullptr);
 
-        if (m_query_pools[0] != VK_NULL_HANDLE) {
-            m_context->device_table().vkDestroyQueryPool(m_context->device(), m_query_pools[0], nullptr);
-            m_context->device_table().vkDestroyQueryPool(m_context->device(), m_query_pools[1], nullptr);
+        for (auto query_pool : m_query_pools) {
+            m_context->device_table().vkDestroyQueryPool(m_context->device(), query_pool, nullptr);
         }
 
         m_pipelines.clear();
@@ -111,75 +87,19 @@ namespace milg::graphics {
             return nullptr;
         }
 
-        std::vector<VkDescriptorSetLayoutBinding> texture_bindings;
-        for (uint32_t i = 0; i < texture_input_count; i++) {
-            texture_bindings.push_back({
-                .binding            = i,
-                .descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                .descriptorCount    = 1,
-                .stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT,
-                .pImmutableSamplers = nullptr,
-            });
+        if (texture_input_count > Pipeline::MAX_IMAGE_BINDINGS) {
+            MILG_ERROR("Pipeline {} uses {} images, at most {} are supported", name, texture_input_count,
+                       Pipeline::MAX_IMAGE_BINDINGS);
+            return nullptr;
         }
 
-        const VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info = {
-            .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-            .pNext        = nullptr,
-            .flags        = 0,
-            .bindingCount = static_cast<uint32_t>(texture_bindings.size()),
-            .pBindings    = texture_bindings.data(),
-        };
-
-        VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
-        m_context->device_table().vkCreateDescriptorSetLayout(m_context->device(), &descriptor_set_layout_info, nullptr,
-                                                              &descriptor_set_layout);
-
-        const VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
-            .sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-            .pNext              = nullptr,
-            .descriptorPool     = m_global_descriptor_pool,
-            .descriptorSetCount = 1,
-            .pSetLayouts        = &descriptor_set_layout,
-        };
-
-        VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
-        m_context->device_table().vkAllocateDescriptorSets(m_context->device(), &descriptor_set_allocate_info,
-                                                           &descriptor_set);
-
-        auto load_shader_module = [&](const std::string &shader_id) -> VkShaderModule {
-            VkShaderModule shader_module = VK_NULL_HANDLE;
-
-            MILG_INFO("Loading shader module: {}", shader_id);
-
-            if (auto shader = AssetStore::load<Bytes>(shader_id); shader.has_value()) {
-                const VkShaderModuleCreateInfo shader_module_info = {
-                    .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-                    .pNext    = nullptr,
-                    .flags    = 0,
-                    .codeSize = (*shader)->size(),
-                    .pCode    = reinterpret_cast<const uint32_t *>((*shader)->data()),
-                };
-
-                VK_CHECK(m_context->device_table().vkCreateShaderModule(m_context->device(), &shader_module_info,
-                                                                        nullptr, &shader_module));
-            }
-
-            return shader_module;
-        };
-
-        VkShaderModule shader_module = load_shader_module(shader_id);
-
-        const VkPipelineShaderStageCreateInfo shader_stage_info = {
-            .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
-            .module = shader_module,
-            .pName  = "main",
-        };
+        // Every pipeline shares the heap's set, only the push constants differ
+        const VkDescriptorSetLayout descriptor_set_layout = m_context->descriptor_heap().layout();
 
         const VkPushConstantRange push_constant_range = {
             .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
             .offset     = 0,
-            .size       = push_constant_size,
+            .size       = Pipeline::PUSH_CONSTANT_OFFSET + push_constant_size,
         };
 
         const VkPipelineLayoutCreateInfo pipeline_layout_info = {
@@ -188,35 +108,29 @@ namespace milg::graphics {
             .flags                  = 0,
             .setLayoutCount         = 1,
             .pSetLayouts            = &descriptor_set_layout,
-            .pushConstantRangeCount = push_constant_size > 0 ? 1u : 0u,
-            .pPushConstantRanges    = push_constant_size > 0 ? &push_constant_range : nullptr,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges    = &push_constant_range,
         };
 
         VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
         VK_CHECK(m_context->device_table().vkCreatePipelineLayout(m_context->device(), &pipeline_layout_info, nullptr,
                                                                   &pipeline_layout));
 
-        const VkComputePipelineCreateInfo pipeline_info = {
-            .sType              = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-            .pNext              = nullptr,
-            .flags              = 0,
-            .stage              = shader_stage_info,
-            .layout             = pipeline_layout,
-            .basePipelineHandle = VK_NULL_HANDLE,
-            .basePipelineIndex  = 0,
-        };
-
-        VkPipeline pipeline_handle = VK_NULL_HANDLE;
-        VK_CHECK(m_context->device_table().vkCreateComputePipelines(m_context->device(), VK_NULL_HANDLE, 1,
-                                                                    &pipeline_info, nullptr, &pipeline_handle));
+        const AssetId    shader_asset    = std::filesystem::path(shader_id);
+        const uint64_t   shader_version  = AssetStore::version(shader_asset);
+        const VkPipeline pipeline_handle = this->build_pipeline(pipeline_layout, shader_asset);
+        if (pipeline_handle == VK_NULL_HANDLE) {
+            m_context->device_table().vkDestroyPipelineLayout(m_context->device(), pipeline_layout, nullptr);
+            return nullptr;
+        }
 
         m_pipelines[name] = {
-            .pipeline    = pipeline_handle,
-            .layout      = pipeline_layout,
-            .set_layout  = descriptor_set_layout,
-            .set         = descriptor_set,
-            .query_pool  = m_query_pools[0],
-            .query_index = static_cast<uint32_t>(m_pipelines.size()) + 1,
+            .pipeline       = pipeline_handle,
+            .layout         = pipeline_layout,
+            .query_pool     = m_query_pools.empty() ? VK_NULL_HANDLE : m_query_pools[m_context->frame_index()],
+            .query_index    = static_cast<uint32_t>(m_pipelines.size()) + 1,
+            .shader_id      = shader_asset,
+            .shader_version = shader_version,
         };
         for (const auto &output_description : output_descriptions) {
             m_pipelines[name].output_buffers.push_back(
@@ -228,28 +142,96 @@ namespace milg::graphics {
                                 },
                                 output_description.width, output_description.height));
         }
-        vkDestroyShaderModule(m_context->device(), shader_module, nullptr);
 
         return &m_pipelines[name];
     }
 
+    VkPipeline PipelineFactory::build_pipeline(VkPipelineLayout layout, AssetId shader_id) {
+        VkShaderModule shader_module = VK_NULL_HANDLE;
+
+        MILG_INFO("Loading shader module: {}", shader_id.path());
+
+        if (auto shader = AssetStore::load<Bytes>(shader_id); shader.has_value()) {
+            const VkShaderModuleCreateInfo shader_module_info = {
+                .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+                .pNext    = nullptr,
+                .flags    = 0,
+                .codeSize = (*shader)->size(),
+                .pCode    = reinterpret_cast<const uint32_t *>((*shader)->data()),
+            };
+
+            VK_CHECK(m_context->device_table().vkCreateShaderModule(m_context->device(), &shader_module_info, nullptr,
+                                                                    &shader_module));
+        } else {
+            MILG_ERROR("Failed to load shader {}", shader_id.path());
+            return VK_NULL_HANDLE;
+        }
+
+        const VkPipelineShaderStageCreateInfo shader_stage_info = {
+            .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shader_module,
+            .pName  = "main",
+        };
+
+        const VkComputePipelineCreateInfo pipeline_info = {
+            .sType              = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .pNext              = nullptr,
+            .flags              = 0,
+            .stage              = shader_stage_info,
+            .layout             = layout,
+            .basePipelineHandle = VK_NULL_HANDLE,
+            .basePipelineIndex  = 0,
+        };
+
+        VkPipeline pipeline_handle = VK_NULL_HANDLE;
+        VK_CHECK(m_context->device_table().vkCreateComputePipelines(
+            m_context->device(), m_context->pipeline_cache(), 1, &pipeline_info, nullptr, &pipeline_handle));
+        m_context->device_table().vkDestroyShaderModule(m_context->device(), shader_module, nullptr);
+
+        return pipeline_handle;
+    }
+
     void PipelineFactory::begin_frame(VkCommandBuffer command_buffer) {
-        if (m_query_pools[m_frame_index] == VK_NULL_HANDLE) {
+        for (auto &[name, pipeline] : m_pipelines) {
+            const uint64_t shader_version = AssetStore::version(pipeline.shader_id);
+            if (shader_version == pipeline.shader_version) {
+                continue;
+            }
+
+            MILG_INFO("Rebuilding pipeline {}", name);
+
+            // A shader that fails to load keeps the old pipeline running until the next save
+            pipeline.shader_version     = shader_version;
+            const VkPipeline new_handle = this->build_pipeline(pipeline.layout, pipeline.shader_id);
+            if (new_handle == VK_NULL_HANDLE) {
+                continue;
+            }
+
+            // Frames in flight may still be executing the old pipeline, it's destroyed once they finished
+            const VulkanContext *context = m_context.get();
+            m_context->descriptor_heap().retire_resource([context, old_handle = pipeline.pipeline] {
+                context->device_table().vkDestroyPipeline(context->device(), old_handle, nullptr);
+            });
+            pipeline.pipeline = new_handle;
+        }
+
+        if (m_query_pools.empty()) {
             return;
         }
 
-        uint32_t last_frame_index = (m_frame_index + 1) % 2;
-        uint32_t count            = m_pipelines.size() + 2;
+        // The frame that last used this slot's pool has finished, so its results are read back before reusing it
+        VkQueryPool query_pool = m_query_pools[m_context->frame_index()];
+        uint32_t    count      = m_pipelines.size() + 2;
 
         std::vector<uint64_t> time_stamp_with_availibility(count * 2);
-        m_context->device_table().vkGetQueryPoolResults(m_context->device(), m_query_pools[last_frame_index], 0, count,
+        m_context->device_table().vkGetQueryPoolResults(m_context->device(), query_pool, 0, count,
                                                         count * sizeof(uint64_t) * 2,
                                                         time_stamp_with_availibility.data(), 2 * sizeof(uint64_t),
                                                         VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
 
-        m_context->device_table().vkResetQueryPool(m_context->device(), m_query_pools[m_frame_index], 0, count);
-        m_context->device_table().vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                                                      m_query_pools[m_frame_index], 0);
+        m_context->device_table().vkResetQueryPool(m_context->device(), query_pool, 0, count);
+        m_context->device_table().vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
         for (auto &[key, pipeline] : m_pipelines) {
             auto start           = time_stamp_with_availibility[pipeline.query_index * 2 + 0];
             auto start_available = time_stamp_with_availibility[pipeline.query_index * 2 + 1];
@@ -270,15 +252,17 @@ namespace milg::graphics {
                 pipeline.execution_time = 0;
             }
 
-            pipeline.query_pool = m_query_pools[m_frame_index];
+            pipeline.query_pool = query_pool;
         }
     }
 
     void PipelineFactory::end_frame(VkCommandBuffer command_buffer) {
-        m_context->device_table().vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                                                      m_query_pools[m_frame_index], m_pipelines.size() + 1);
+        if (m_query_pools.empty()) {
+            return;
+        }
 
-        m_frame_index = (m_frame_index + 1) % 2;
+        m_context->device_table().vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                                      m_query_pools[m_context->frame_index()], m_pipelines.size() + 1);
     }
 
     Pipeline *PipelineFactory::get_pipeline(const std::string &name) {
@@ -299,25 +283,9 @@ namespace milg::graphics {
 
     void Pipeline::bind_texture(const std::shared_ptr<VulkanContext> &context, VkCommandBuffer command_buffer,
                                 uint32_t binding, const std::shared_ptr<Texture> &texture) {
-        VkDescriptorImageInfo image_info = {
-            .sampler     = VK_NULL_HANDLE,
-            .imageView   = texture->image_view(),
-            .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
-        };
-
-        VkWriteDescriptorSet write_descriptor_set = {
-            .sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .pNext            = nullptr,
-            .dstSet           = set,
-            .dstBinding       = binding,
-            .dstArrayElement  = 0,
-            .descriptorCount  = 1,
-            .descriptorType   = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-            .pImageInfo       = &image_info,
-            .pBufferInfo      = nullptr,
-            .pTexelBufferView = nullptr,
-        };
-        context->device_table().vkUpdateDescriptorSets(context->device(), 1, &write_descriptor_set, 0, nullptr);
+        const uint32_t index = texture->storage_descriptor_index();
+        context->device_table().vkCmdPushConstants(command_buffer, layout, VK_SHADER_STAGE_COMPUTE_BIT,
+                                                   binding * sizeof(uint32_t), sizeof(uint32_t), &index);
     }
 
     void Pipeline::begin(const std::shared_ptr<VulkanContext> &context, VkCommandBuffer command_buffer,
@@ -327,6 +295,7 @@ namespace milg::graphics {
                                                         query_pool, query_index);
         }
         context->device_table().vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        const VkDescriptorSet set = context->descriptor_heap().set();
         context->device_table().vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1,
                                                         &set, 0, nullptr);
         if (push_constant_size > 0) {
@@ -344,6 +313,7 @@ namespace milg::graphics {
 
     void Pipeline::set_push_constants(const std::shared_ptr<VulkanContext> &context, VkCommandBuffer command_buffer,
                                       uint32_t size, const void *data) {
-        context->device_table().vkCmdPushConstants(command_buffer, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, size, data);
+        context->device_table().vkCmdPushConstants(command_buffer, layout, VK_SHADER_STAGE_COMPUTE_BIT,
+                                                   PUSH_CONSTANT_OFFSET, size, data);
     }
 } // namespace milg::graphics
@@ -0,0 +1,108 @@
+#include <milg/graphics/pipeline_cache.hpp>
+
+#include <milg/core/logging.hpp>
+#include <milg/core/mapped_file.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+    // Drivers are supposed to reject foreign blobs themselves, not all of them do so gracefully
+    bool is_compatible(const milg::graphics::VulkanContext &context, ByteView data) {
+        VkPipelineCacheHeaderVersionOne header = {};
+        if (data.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        const auto &properties = context.device_properties();
+
+        return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+               std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+} // namespace
+
+namespace milg::graphics {
+    PipelineCache::PipelineCache(const VulkanContext &context) : m_context(context) {
+    }
+
+    std::unique_ptr<PipelineCache> PipelineCache::create(const VulkanContext         &context,
+                                                         const std::filesystem::path &directory) {
+        const auto &properties = context.device_properties();
+
+        std::string uuid;
+        for (uint8_t byte : properties.pipelineCacheUUID) {
+            uuid += std::format("{:02x}", byte);
+        }
+
+        auto cache    = std::unique_ptr<PipelineCache>(new PipelineCache(context));
+        cache->m_path = directory / std::format("pipeline_cache_{}_{:x}.bin", uuid, properties.driverVersion);
+
+        ByteView initial_data = {};
+        auto     file         = MappedFile::create(cache->m_path);
+        if (file != nullptr && is_compatible(context, file->bytes())) {
+            MILG_INFO("Loaded pipeline cache from {} ({} bytes)", cache->m_path.string(), file->size());
+            initial_data = file->bytes();
+        } else if (file != nullptr) {
+            MILG_WARN("Ignoring incompatible pipeline cache {}", cache->m_path.string());
+        }
+
+        const VkPipelineCacheCreateInfo cache_info = {
+            .sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .pNext           = nullptr,
+            .flags           = 0,
+            .initialDataSize = initial_data.size(),
+            .pInitialData    = initial_data.data(),
+        };
+
+        VK_CHECK(context.device_table().vkCreatePipelineCache(context.device(), &cache_info, nullptr, &cache->m_cache));
+
+        return cache;
+    }
+
+    PipelineCache::~PipelineCache() {
+        this->save();
+        m_context.device_table().vkDestroyPipelineCache(m_context.device(), m_cache, nullptr);
+    }
+
+    bool PipelineCache::save() const {
+        size_t size = 0;
+        VK_CHECK(m_context.device_table().vkGetPipelineCacheData(m_context.device(), m_cache, &size, nullptr));
+
+        std::vector<char> data(size);
+        VK_CHECK(m_context.device_table().vkGetPipelineCacheData(m_context.device(), m_cache, &size, data.data()));
+
+        std::error_code error;
+        std::filesystem::create_directories(m_path.parent_path(), error);
+
+        // Written next to the cache and renamed over it, so a crash while saving never leaves a truncated blob behind
+        auto temporary_path = std::filesystem::path(m_path).replace_extension(".tmp");
+        {
+            std::ofstream stream(temporary_path, std::ios::binary | std::ios::out | std::ios::trunc);
+            if (!stream.is_open() || !stream.write(data.data(), static_cast<std::streamsize>(size))) {
+                MILG_WARN("Failed to write pipeline cache {}", temporary_path.string());
+                return false;
+            }
+        }
+
+        std::filesystem::rename(temporary_path, m_path, error);
+        if (error) {
+            MILG_WARN("Failed to save pipeline cache {}: {}", m_path.string(), error.message());
+            return false;
+        }
+
+        MILG_INFO("Saved pipeline cache to {} ({} bytes)", m_path.string(), size);
+
+        return true;
+    }
+
+    VkPipelineCache PipelineCache::handle() const {
+        return m_cache;
+    }
+} // namespace milg::graphics
@@ -0,0 +1,391 @@
+#include <milg/core/error.hpp>
+#include <milg/core/logging.hpp>
+#include <milg/graphics/barrier_batch.hpp>
+#include <milg/graphics/render_graph.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace milg::graphics {
+    namespace {
+        const VkAccessFlags2 WRITE_ACCESS = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT |
+                                            VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+
+        struct AccessInfo {
+            VkPipelineStageFlags2 stages = 0;
+            VkAccessFlags2        access = 0;
+            VkImageLayout         layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        };
+
+        AccessInfo access_info(ImageAccess access) {
+            switch (access) {
+            case ImageAccess::COMPUTE_READ:
+                return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+                        VK_IMAGE_LAYOUT_GENERAL};
+            case ImageAccess::COMPUTE_WRITE:
+                return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_GENERAL};
+            case ImageAccess::COMPUTE_READ_WRITE:
+                return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_GENERAL};
+            case ImageAccess::TRANSFER_READ:
+                return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+            case ImageAccess::TRANSFER_WRITE:
+                return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+            case ImageAccess::COLOR_ATTACHMENT_WRITE:
+                return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+            }
+
+            return {};
+        }
+
+        bool is_read(ImageAccess access) {
+            return (access_info(access).access & ~WRITE_ACCESS) != 0;
+        }
+
+        bool is_write(ImageAccess access) {
+            return (access_info(access).access & WRITE_ACCESS) != 0;
+        }
+    } // namespace
+
+    std::shared_ptr<RenderGraph> RenderGraph::create(const std::shared_ptr<VulkanContext> &context) {
+        auto graph       = std::shared_ptr<RenderGraph>(new RenderGraph());
+        graph->m_context = context;
+
+        return graph;
+    }
+
+    RenderGraph::~RenderGraph() {
+        // Aliased images have to go before the memory they live in
+        m_images.clear();
+        for (auto allocation : m_transient_memory) {
+            vmaFreeMemory(m_context->allocator(), allocation);
+        }
+    }
+
+    RenderGraphImage RenderGraph::import_texture(const std::shared_ptr<Texture> &texture) {
+        m_memory_states.push_back({});
+        m_images.push_back({
+            .texture = texture,
+            .width   = texture->width(),
+            .height  = texture->height(),
+            .memory  = static_cast<uint32_t>(m_memory_states.size() - 1),
+        });
+
+        return static_cast<RenderGraphImage>(m_images.size() - 1);
+    }
+
+    RenderGraphImage RenderGraph::create_texture(const std::string &name, const TextureCreateInfo &create_info,
+                                                 uint32_t width, uint32_t height) {
+        m_images.push_back({
+            .name        = name,
+            .create_info = create_info,
+            .width       = width,
+            .height      = height,
+            .transient   = true,
+        });
+
+        return static_cast<RenderGraphImage>(m_images.size() - 1);
+    }
+
+    void RenderGraph::mark_output(RenderGraphImage image) {
+        m_images[image].output = true;
+    }
+
+    void RenderGraph::add_pass(RenderPassDescription pass) {
+        if (m_compiled) {
+            MILG_ERROR("Render graph is already compiled, pass {} is ignored", pass.name);
+            return;
+        }
+
+        m_passes.push_back({.description = std::move(pass)});
+    }
+
+    void RenderGraph::compile() {
+        if (m_compiled) {
+            return;
+        }
+
+        cull_passes();
+        place_transients();
+
+        m_compiled = true;
+    }
+
+    void RenderGraph::execute(VkCommandBuffer command_buffer) {
+        compile();
+
+        for (auto &image : m_images) {
+            if (image.transient) {
+                // Contents are dropped, the memory state still orders the first use after the previous occupant
+                image.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                continue;
+            }
+
+            // Anything recorded outside the graph may have touched an imported image since the last frame
+            image.layout                  = image.texture->layout();
+            m_memory_states[image.memory] = {
+                .write_stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .write_access = VK_ACCESS_2_MEMORY_WRITE_BIT,
+            };
+        }
+
+        m_barrier_count = 0;
+
+        BarrierBatch barriers;
+        for (auto &pass : m_passes) {
+            if (pass.culled) {
+                continue;
+            }
+
+            for (const auto &use : pass.description.images) {
+                auto      &image  = m_images[use.image];
+                auto      &state  = m_memory_states[image.memory];
+                const auto info   = access_info(use.access);
+                const auto writes = info.access & WRITE_ACCESS;
+                const auto reads  = info.access & ~WRITE_ACCESS;
+
+                VkImageMemoryBarrier2 barrier = {
+                    .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                    .pNext               = nullptr,
+                    .srcStageMask        = 0,
+                    .srcAccessMask       = 0,
+                    .dstStageMask        = info.stages,
+                    .dstAccessMask       = info.access,
+                    .oldLayout           = image.layout,
+                    .newLayout           = info.layout,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .image               = image.texture->handle(),
+                    .subresourceRange    = {.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                                            .baseMipLevel   = 0,
+                                            .levelCount     = image.texture->mip_levels(),
+                                            .baseArrayLayer = 0,
+                                            .layerCount     = 1},
+                };
+
+                bool needed = false;
+                if (image.layout != info.layout || writes != 0) {
+                    // Transitions and writes wait for every earlier access, only a pending write has to be flushed
+                    barrier.srcStageMask  = state.write_stages | state.read_stages;
+                    barrier.srcAccessMask = state.write_access;
+                    needed                = image.layout != info.layout || barrier.srcStageMask != 0;
+
+                    state = {
+                        .write_stages   = info.stages,
+                        .write_access   = writes,
+                        .read_stages    = reads != 0 ? info.stages : 0,
+                        .visible_stages = writes != 0 ? 0 : info.stages,
+                        .visible_access = writes != 0 ? 0 : reads,
+                    };
+                } else {
+                    // Reads in the same layout only wait if the last write isn't visible to them yet
+                    const bool unseen =
+                        (info.stages & ~state.visible_stages) != 0 || (reads & ~state.visible_access) != 0;
+
+                    barrier.srcStageMask  = state.write_stages;
+                    barrier.srcAccessMask = state.write_access;
+                    needed                = state.write_stages != 0 && unseen;
+
+                    if (needed) {
+                        state.visible_stages |= info.stages;
+                        state.visible_access |= reads;
+                    }
+                    state.read_stages |= info.stages;
+                }
+
+                image.layout = info.layout;
+                if (needed) {
+                    barriers.add(barrier);
+                }
+            }
+
+            if (!barriers.empty()) {
+                barriers.flush(*m_context, command_buffer);
+                m_barrier_count++;
+            }
+
+            pass.description.execute(command_buffer);
+        }
+
+        for (auto &image : m_images) {
+            if (image.texture != nullptr) {
+                image.texture->set_layout(image.layout);
+            }
+        }
+    }
+
+    const std::shared_ptr<Texture> &RenderGraph::texture(RenderGraphImage image) const {
+        return m_images[image].texture;
+    }
+
+    uint32_t RenderGraph::pass_count() const {
+        return static_cast<uint32_t>(m_passes.size());
+    }
+
+    uint32_t RenderGraph::culled_pass_count() const {
+        return m_culled_pass_count;
+    }
+
+    uint32_t RenderGraph::barrier_count() const {
+        return m_barrier_count;
+    }
+
+    VkDeviceSize RenderGraph::transient_memory() const {
+        return m_transient_size;
+    }
+
+    VkDeviceSize RenderGraph::transient_memory_without_aliasing() const {
+        return m_unaliased_transient_size;
+    }
+
+    void RenderGraph::cull_passes() {
+        std::vector<bool> needed(m_images.size(), false);
+        for (size_t i = 0; i < m_images.size(); i++) {
+            needed[i] = m_images[i].output;
+        }
+
+        // Walking backwards, a pass lives if a later live pass reads what it writes
+        m_culled_pass_count = 0;
+        for (auto pass = m_passes.rbegin(); pass != m_passes.rend(); ++pass) {
+            bool live = pass->description.side_effect;
+            for (const auto &use : pass->description.images) {
+                live = live || (is_write(use.access) && needed[use.image]);
+            }
+
+            pass->culled = !live;
+            if (!live) {
+                MILG_DEBUG("Culling render pass {}", pass->description.name);
+                m_culled_pass_count++;
+                continue;
+            }
+
+            for (const auto &use : pass->description.images) {
+                if (is_read(use.access)) {
+                    needed[use.image] = true;
+                }
+            }
+        }
+    }
+
+    void RenderGraph::place_transients() {
+        struct Lifetime {
+            uint32_t first = UINT32_MAX;
+            uint32_t last  = 0;
+        };
+
+        struct Slot {
+            VkMemoryRequirements requirements = {};
+            uint32_t             last_use     = 0;
+        };
+
+        std::vector<Lifetime> lifetimes(m_images.size());
+        for (uint32_t i = 0; i < m_passes.size(); i++) {
+            if (m_passes[i].culled) {
+                continue;
+            }
+
+            for (const auto &use : m_passes[i].description.images) {
+                lifetimes[use.image].first = std::min(lifetimes[use.image].first, i);
+                lifetimes[use.image].last  = std::max(lifetimes[use.image].last, i);
+            }
+        }
+
+        std::vector<uint32_t> order(m_images.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&lifetimes](uint32_t a, uint32_t b) {
+            return lifetimes[a].first < lifetimes[b].first;
+        });
+
+        std::vector<Slot>     slots;
+        std::vector<uint32_t> image_slots(m_images.size(), 0);
+        for (auto index : order) {
+            auto &image = m_images[index];
+            if (!image.transient) {
+                continue;
+            }
+
+            if (lifetimes[index].first == UINT32_MAX) {
+                MILG_WARN("Transient image {} isn't used by any render pass", image.name);
+                continue;
+            }
+
+            const auto requirements =
+                Texture::memory_requirements(m_context, image.create_info, image.width, image.height);
+            m_unaliased_transient_size += requirements.size;
+
+            // Reuses the free slot that has to grow the least, only images whose lifetimes don't overlap share one
+            size_t best_slot   = slots.size();
+            auto   best_growth = VkDeviceSize(UINT64_MAX);
+            for (size_t i = 0; i < slots.size(); i++) {
+                const auto &slot = slots[i];
+                if (slot.last_use >= lifetimes[index].first ||
+                    (slot.requirements.memoryTypeBits & requirements.memoryTypeBits) == 0) {
+                    continue;
+                }
+
+                const VkDeviceSize size   = std::max(slot.requirements.size, requirements.size);
+                const VkDeviceSize growth = size - slot.requirements.size;
+                if (growth < best_growth) {
+                    best_slot   = i;
+                    best_growth = growth;
+                }
+            }
+
+            if (best_slot == slots.size()) {
+                slots.push_back({.requirements = requirements});
+            }
+
+            auto &slot                  = slots[best_slot];
+            slot.requirements.size      = std::max(slot.requirements.size, requirements.size);
+            slot.requirements.alignment = std::max(slot.requirements.alignment, requirements.alignment);
+            slot.last_use               = lifetimes[index].last;
+            image_slots[index]          = static_cast<uint32_t>(best_slot);
+
+            slot.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+        }
+
+        const VmaAllocationCreateInfo allocation_create_info = {
+            .flags          = 0,
+            .usage          = VMA_MEMORY_USAGE_GPU_ONLY,
+            .requiredFlags  = 0,
+            .preferredFlags = 0,
+            .memoryTypeBits = 0,
+            .pool           = VK_NULL_HANDLE,
+            .pUserData      = nullptr,
+            .priority       = 0.0f,
+        };
+
+        const auto first_slot_state = static_cast<uint32_t>(m_memory_states.size());
+        for (const auto &slot : slots) {
+            VmaAllocation allocation = VK_NULL_HANDLE;
+            VK_CHECK(vmaAllocateMemory(m_context->allocator(), &slot.requirements, &allocation_create_info,
+                                       &allocation, nullptr));
+
+            m_transient_memory.push_back(allocation);
+            m_memory_states.push_back({});
+            m_transient_size += slot.requirements.size;
+        }
+
+        for (uint32_t i = 0; i < m_images.size(); i++) {
+            auto &image = m_images[i];
+            if (!image.transient || lifetimes[i].first == UINT32_MAX) {
+                continue;
+            }
+
+            image.memory  = first_slot_state + image_slots[i];
+            image.texture = Texture::create_aliased(m_context, image.create_info, image.width, image.height,
+                                                    m_transient_memory[image_slots[i]], 0);
+        }
+
+        MILG_INFO("Render graph placed its transient images in {} KiB instead of {} KiB", m_transient_size / 1024,
+                  m_unaliased_transient_size / 1024);
+    }
+} // namespace milg::graphics
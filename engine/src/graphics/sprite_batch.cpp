@@ -2,12 +2,31 @@
 
 #include <milg/core/asset.hpp>
 #include <milg/core/logging.hpp>
+#include <milg/graphics/descriptor_heap.hpp>
 #include <milg/graphics/vk_context.hpp>
 
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
 #include <array>
+#include <cstddef>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <span>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define MILG_SPRITE_SSE2
+#include <emmintrin.h>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define MILG_SPRITE_NEON
+#include <arm_neon.h>
+#endif
 
 namespace milg::graphics {
     VkShaderModule load_shader_module(const std::shared_ptr<Bytes>         &bytes,
@@ -28,9 +47,72 @@ namespace milg::graphics {
         return shader_module;
     }
 
+    namespace {
+        // Quantizes the vector parts four lanes at a time, only the rotation is converted on its own
+        SpriteInstance pack_sprite(const Sprite &sprite, uint16_t texture_index) {
+            const float turns = glm::fract(sprite.rotation / glm::two_pi<float>());
+
+            SpriteInstance instance = {
+                .position               = sprite.position,
+                .rotation_texture_index = {static_cast<uint16_t>(static_cast<uint32_t>(turns * 65536.0f + 0.5f)),
+                                           texture_index},
+            };
+
+#if defined(MILG_SPRITE_SSE2)
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one  = _mm_set1_ps(1.0f);
+            const __m128 uvs  = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&sprite.uvs.x), zero), one);
+            const __m128 rgba = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&sprite.color.x), zero), one);
+
+            // SSE2 has no unsigned 32 to 16 bit pack, so the values are moved into the signed range and back
+            __m128i uvs32 = _mm_cvtps_epi32(_mm_mul_ps(uvs, _mm_set1_ps(65535.0f)));
+            uvs32         = _mm_sub_epi32(uvs32, _mm_set1_epi32(32768));
+            __m128i uvs16 = _mm_packs_epi32(uvs32, uvs32);
+            uvs16         = _mm_xor_si128(uvs16, _mm_set1_epi16(static_cast<int16_t>(0x8000)));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(&instance.uvs), uvs16);
+
+            const __m128i rgba32 = _mm_cvtps_epi32(_mm_mul_ps(rgba, _mm_set1_ps(255.0f)));
+            const __m128i rgba16 = _mm_packs_epi32(rgba32, rgba32);
+            instance.color       = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(rgba16, rgba16)));
+
+#if defined(__F16C__)
+            const __m128 size = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(&sprite.size)));
+            instance.size     = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_cvtps_ph(size, _MM_FROUND_TO_NEAREST_INT)));
+#else
+            instance.size = glm::packHalf2x16(sprite.size);
+#endif
+#elif defined(MILG_SPRITE_NEON)
+            const float32x4_t zero = vdupq_n_f32(0.0f);
+            const float32x4_t one  = vdupq_n_f32(1.0f);
+            const float32x4_t uvs  = vminq_f32(vmaxq_f32(vld1q_f32(&sprite.uvs.x), zero), one);
+            const float32x4_t rgba = vminq_f32(vmaxq_f32(vld1q_f32(&sprite.color.x), zero), one);
+
+            vst1_u16(&instance.uvs.x, vmovn_u32(vcvtnq_u32_f32(vmulq_n_f32(uvs, 65535.0f))));
+
+            const uint16x4_t rgba16 = vmovn_u32(vcvtnq_u32_f32(vmulq_n_f32(rgba, 255.0f)));
+            instance.color          = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(rgba16, rgba16))), 0);
+
+            const float16x4_t size = vcvt_f16_f32(vcombine_f32(vld1_f32(&sprite.size.x), vdup_n_f32(0.0f)));
+            instance.size          = vget_lane_u32(vreinterpret_u32_f16(size), 0);
+#else
+            instance.size  = glm::packHalf2x16(sprite.size);
+            instance.uvs   = glm::packUnorm<uint16_t>(sprite.uvs);
+            instance.color = glm::packUnorm4x8(sprite.color);
+#endif
+
+            return instance;
+        }
+    } // namespace
+
     std::shared_ptr<SpriteBatch> SpriteBatch::create(const std::shared_ptr<VulkanContext> &context,
-                                                     VkFormat albdedo_render_format, uint32_t capacity) {
-        MILG_INFO("Creating sprite batch with capacity: {}", capacity);
+                                                     VkFormat albdedo_render_format, uint32_t page_capacity,
+                                                     uint32_t shrink_after_frames) {
+        MILG_INFO("Creating sprite batch with page capacity: {}", page_capacity);
+
+        if (page_capacity == 0) {
+            MILG_ERROR("Sprite batch page capacity must not be 0");
+            return nullptr;
+        }
 
         VkShaderModule vertex_shader_module   = VK_NULL_HANDLE;
         VkShaderModule fragment_shader_module = VK_NULL_HANDLE;
@@ -56,132 +138,12 @@ namespace milg::graphics {
             return nullptr;
         }
 
-        VkPhysicalDeviceType     device_type = context->device_properties().deviceType;
-        VmaAllocationCreateFlags allocation_flags =
-            device_type == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU
-                ? VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT
-                : VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
-        VmaMemoryUsage memory_usage = device_type == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU
-                                          ? VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
-                                          : VMA_MEMORY_USAGE_AUTO;
-
-        VkBufferUsageFlags buffer_usage_flags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-
-        BufferCreateInfo buffer_create_info = {
-            .size             = capacity * Sprite::ATTRIB_COUNT * sizeof(float),
-            .memory_usage     = memory_usage,
-            .allocation_flags = allocation_flags,
-            .usage_flags      = buffer_usage_flags,
-        };
-        auto geometry_buffer = Buffer::create(context, buffer_create_info);
+        // Sprites of the next frame are written while the previous ones are still being drawn, so every frame slot
+        // gets its own pages. They are only created once sprites are drawn into them
+        std::vector<Frame> frames(context->frames_in_flight());
 
-        VkMemoryPropertyFlags memory_property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-        vmaGetMemoryTypeProperties(context->allocator(), geometry_buffer->allocation_info().memoryType,
-                                   &memory_property_flags);
-
-        std::shared_ptr<Buffer> backing_buffer = nullptr;
-        if (memory_property_flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT &&
-            !(memory_property_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
-            // If the buffer ended up in device local, non host visible memory, we
-            // need to create a staging buffer that is host visible and mappable to
-            // copy the data to the device local buffer later on
-            MILG_INFO("Creating device local, non host visible buffer");
-            buffer_create_info.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
-            buffer_create_info.usage_flags  = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-            buffer_create_info.allocation_flags =
-                VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-
-            backing_buffer = Buffer::create(context, buffer_create_info);
-        } else {
-            // If the buffer ended up in host visible, mappable memory, we'll use a
-            // vector to store the data and copy it to the buffer later on in
-            // one go
-            MILG_INFO("Creating host visible, mappable buffer");
-        }
-
-        const std::array<VkDescriptorPoolSize, 2> pool_sizes = {
-            VkDescriptorPoolSize{
-                .type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .descriptorCount = SpriteBatch::TEXTURE_DESCRIPTOR_BINDING_COUNT,
-            },
-            {
-                .type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .descriptorCount = 1,
-            },
-        };
-
-        const VkDescriptorPoolCreateInfo descriptor_pool_info = {
-            .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-            .pNext         = nullptr,
-            .flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
-            .maxSets       = SpriteBatch::TEXTURE_DESCRIPTOR_BINDING_COUNT + 1,
-            .poolSizeCount = pool_sizes.size(),
-            .pPoolSizes    = pool_sizes.data(),
-        };
-
-        VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
-        VK_CHECK(context->device_table().vkCreateDescriptorPool(context->device(), &descriptor_pool_info, nullptr,
-                                                                &descriptor_pool));
-
-        const std::array<VkDescriptorSetLayoutBinding, 2> bindings = {
-            VkDescriptorSetLayoutBinding{
-                .binding            = 0,
-                .descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                .descriptorCount    = 1,
-                .stageFlags         = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                .pImmutableSamplers = nullptr,
-            },
-            {
-                .binding            = 1,
-                .descriptorType     = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .descriptorCount    = SpriteBatch::TEXTURE_DESCRIPTOR_BINDING_COUNT,
-                .stageFlags         = VK_SHADER_STAGE_FRAGMENT_BIT,
-                .pImmutableSamplers = nullptr,
-            },
-        };
-
-        const std::array<VkDescriptorBindingFlags, 2> layout_flags = {
-            0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
-                   VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT};
-
-        const VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {
-            .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
-            .pNext         = nullptr,
-            .bindingCount  = layout_flags.size(),
-            .pBindingFlags = layout_flags.data(),
-        };
-
-        const VkDescriptorSetLayoutCreateInfo layout_info = {
-            .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-            .pNext        = &binding_flags_info,
-            .flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
-            .bindingCount = bindings.size(),
-            .pBindings    = bindings.data(),
-        };
-
-        VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
-        VK_CHECK(context->device_table().vkCreateDescriptorSetLayout(context->device(), &layout_info, nullptr,
-                                                                     &descriptor_set_layout));
-
-        uint32_t descriptor_count = SpriteBatch::TEXTURE_DESCRIPTOR_BINDING_COUNT;
-        const VkDescriptorSetVariableDescriptorCountAllocateInfo variable_count_info = {
-            .sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
-            .pNext              = nullptr,
-            .descriptorSetCount = 1,
-            .pDescriptorCounts  = &descriptor_count,
-        };
-
-        const VkDescriptorSetAllocateInfo descriptor_set_info = {
-            .sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-            .pNext              = &variable_count_info,
-            .descriptorPool     = descriptor_pool,
-            .descriptorSetCount = 1,
-            .pSetLayouts        = &descriptor_set_layout,
-        };
-
-        VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
-        VK_CHECK(
-            context->device_table().vkAllocateDescriptorSets(context->device(), &descriptor_set_info, &descriptor_set));
+        // Sprites index the heap's texture array directly, nothing has to be written per frame
+        const VkDescriptorSetLayout descriptor_set_layout = context->descriptor_heap().layout();
 
         const VkPushConstantRange push_constants = {
             .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
@@ -226,38 +188,40 @@ namespace milg::graphics {
 
         const VkVertexInputBindingDescription vertex_binding = {
             .binding   = 0,
-            .stride    = Sprite::ATTRIB_COUNT * sizeof(float),
+            .stride    = sizeof(SpriteInstance),
             .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
         };
 
-        const std::array<VkVertexInputAttributeDescription, 4> vertex_attribs = {
-            // x, y, width, height
+        const std::array<VkVertexInputAttributeDescription, 5> vertex_attribs = {
             VkVertexInputAttributeDescription{
                 .location = 0,
                 .binding  = 0,
-                .format   = VK_FORMAT_R32G32B32A32_SFLOAT,
-                .offset   = 0,
+                .format   = VK_FORMAT_R32G32_SFLOAT,
+                .offset   = offsetof(SpriteInstance, position),
             },
-            // u, v, u2, v2
             VkVertexInputAttributeDescription{
                 .location = 1,
                 .binding  = 0,
-                .format   = VK_FORMAT_R32G32B32A32_SFLOAT,
-                .offset   = 4 * sizeof(float),
+                .format   = VK_FORMAT_R16G16_SFLOAT,
+                .offset   = offsetof(SpriteInstance, size),
             },
-            // r, g, b, a
             VkVertexInputAttributeDescription{
                 .location = 2,
                 .binding  = 0,
-                .format   = VK_FORMAT_R32G32B32A32_SFLOAT,
-                .offset   = 8 * sizeof(float),
+                .format   = VK_FORMAT_R16G16B16A16_UNORM,
+                .offset   = offsetof(SpriteInstance, uvs),
             },
-            // rotation, texture_index
             VkVertexInputAttributeDescription{
                 .location = 3,
                 .binding  = 0,
-                .format   = VK_FORMAT_R32G32_SFLOAT,
-                .offset   = 12 * sizeof(float),
+                .format   = VK_FORMAT_R8G8B8A8_UNORM,
+                .offset   = offsetof(SpriteInstance, color),
+            },
+            VkVertexInputAttributeDescription{
+                .location = 4,
+                .binding  = 0,
+                .format   = VK_FORMAT_R16G16_UINT,
+                .offset   = offsetof(SpriteInstance, rotation_texture_index),
             },
         };
 
@@ -391,56 +355,168 @@ namespace milg::graphics {
         };
 
         VkPipeline pipeline = VK_NULL_HANDLE;
-        VK_CHECK(context->device_table().vkCreateGraphicsPipelines(context->device(), VK_NULL_HANDLE, 1, &pipeline_info,
-                                                                   nullptr, &pipeline));
+        VK_CHECK(context->device_table().vkCreateGraphicsPipelines(context->device(), context->pipeline_cache(), 1,
+                                                                   &pipeline_info, nullptr, &pipeline));
 
         auto batch                      = std::shared_ptr<SpriteBatch>(new SpriteBatch());
         batch->m_context                = context;
-        batch->m_capacity               = capacity;
-        batch->m_geometry_buffer        = geometry_buffer;
-        batch->m_backing_buffer         = backing_buffer;
-        batch->m_descriptor_pool        = descriptor_pool;
-        batch->m_descriptor_set_layout  = descriptor_set_layout;
-        batch->m_descriptor_set         = descriptor_set;
+        batch->m_page_capacity          = page_capacity;
+        batch->m_shrink_after_frames    = shrink_after_frames;
+        batch->m_frames                 = std::move(frames);
         batch->m_pipeline_layout        = pipeline_layout;
         batch->m_pipeline               = pipeline;
         batch->m_vertex_shader_module   = vertex_shader_module;
         batch->m_fragment_shader_module = fragment_shader_module;
 
-        if (backing_buffer == nullptr) {
-            batch->m_geometry_cache.resize(Sprite::ATTRIB_COUNT * capacity);
+        return batch;
+    }
+
+    SpriteBatch::Page SpriteBatch::create_page() const {
+        // Prefers memory that is both device local and host visible (ReBAR or the smaller BAR heap), sprites are then
+        // written straight into the buffer the GPU reads. VMA falls back to device local memory that can't be mapped
+        // only when there is none, in which case sprites go through a staging buffer
+        const VmaAllocationCreateFlags allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                                                          VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+                                                          VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        const VkBufferUsageFlags buffer_usage_flags =
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+        BufferCreateInfo buffer_create_info = {
+            .size             = m_page_capacity * sizeof(SpriteInstance),
+            .memory_usage     = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .allocation_flags = allocation_flags,
+            .usage_flags      = buffer_usage_flags,
+        };
+
+        Page page            = {};
+        page.geometry_buffer = Buffer::create(m_context, buffer_create_info);
+
+        VkMemoryPropertyFlags memory_property_flags = 0;
+        vmaGetMemoryTypeProperties(m_context->allocator(), page.geometry_buffer->allocation_info().memoryType,
+                                   &memory_property_flags);
+
+        if (memory_property_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            MILG_DEBUG("Creating host visible sprite geometry page");
+            page.geometry_data = static_cast<SpriteInstance *>(page.geometry_buffer->allocation_info().pMappedData);
+        } else {
+            MILG_DEBUG("Creating device local sprite geometry page with a staging buffer");
+            buffer_create_info.memory_usage     = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+            buffer_create_info.usage_flags      = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            buffer_create_info.allocation_flags =
+                VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+            page.backing_buffer = Buffer::create(m_context, buffer_create_info);
+            page.geometry_data  = static_cast<SpriteInstance *>(page.backing_buffer->allocation_info().pMappedData);
         }
 
-        return batch;
+        return page;
     }
 
     void SpriteBatch::draw_sprite(Sprite &sprite, const std::shared_ptr<Texture> &texture) {
-        if (m_sprite_count >= m_capacity) {
-            MILG_ERROR("SpriteBatch::draw_sprite: Exceeded capacity");
+        auto instances = reserve_sprites(1, texture);
+        if (instances.instances.empty()) {
             return;
         }
 
+        sprite.texture_index = instances.texture_index;
+
+        // Write only, the memory may be write combined
+        const SpriteInstance instance = pack_sprite(sprite, instances.texture_index);
+        memcpy(instances.instances.data(), &instance, sizeof(SpriteInstance));
+    }
+
+    void SpriteBatch::draw_sprites(std::span<const Sprite> sprites, const std::shared_ptr<Texture> &texture) {
+        while (!sprites.empty()) {
+            auto instances = reserve_sprites(static_cast<uint32_t>(sprites.size()), texture);
+            if (instances.instances.empty()) {
+                return;
+            }
+
+            for (size_t i = 0; i < instances.instances.size(); i++) {
+                const SpriteInstance instance = pack_sprite(sprites[i], instances.texture_index);
+                memcpy(&instances.instances[i], &instance, sizeof(SpriteInstance));
+            }
+            sprites = sprites.subspan(instances.instances.size());
+        }
+    }
+
+    void SpriteBatch::draw_sprites(std::span<const Sprite> sprites) {
+        while (!sprites.empty()) {
+            // Indices outside the 16 bit range, or NaN, would sample past the texture array. Such sprites are dropped
+            const auto invalid = std::find_if(sprites.begin(), sprites.end(), [](const Sprite &sprite) {
+                return !(sprite.texture_index >= 0.0f && sprite.texture_index <= UINT16_MAX);
+            });
+            const auto valid_count = static_cast<uint32_t>(invalid - sprites.begin());
+            if (valid_count == 0) {
+                MILG_ERROR("SpriteBatch::draw_sprites: Sprite has no valid texture index");
+                sprites = sprites.subspan(1);
+                continue;
+            }
+
+            auto instances = reserve(valid_count);
+            if (instances.empty()) {
+                return;
+            }
+
+            for (size_t i = 0; i < instances.size(); i++) {
+                const auto           texture_index = static_cast<uint16_t>(sprites[i].texture_index);
+                const SpriteInstance instance      = pack_sprite(sprites[i], texture_index);
+                memcpy(&instances[i], &instance, sizeof(SpriteInstance));
+            }
+            sprites = sprites.subspan(instances.size());
+        }
+    }
+
+    SpriteBatch::Reservation SpriteBatch::reserve_sprites(uint32_t count, const std::shared_ptr<Texture> &texture) {
+        // Instances store the slot in 16 bits, the heap never hands out more texture slots than that
+        const uint32_t texture_index = texture->descriptor_index();
+        if (texture_index > UINT16_MAX) {
+            MILG_ERROR("SpriteBatch::reserve_sprites: Texture has no valid descriptor index");
+            return {};
+        }
+
+        return {
+            .instances     = reserve(count),
+            .texture_index = static_cast<uint16_t>(texture_index),
+        };
+    }
+
+    std::span<SpriteInstance> SpriteBatch::reserve(uint32_t count) {
         if (m_batches.size() == 0) {
-            MILG_ERROR("SpriteBatch::draw_sprite: No active batch");
-            return;
+            MILG_ERROR("SpriteBatch::reserve: No active batch");
+            return {};
         }
 
-        auto &batch = m_batches.back();
+        auto          &frame      = m_frames[m_context->frame_index()];
+        const uint32_t page_index = m_sprite_count / m_page_capacity;
+        const uint32_t offset     = m_sprite_count % m_page_capacity;
+        if (page_index == frame.pages.size()) {
+            frame.pages.push_back(create_page());
+        }
 
-        sprite.texture_index = register_texture(texture);
+        count          = std::min(count, m_page_capacity - offset);
+        auto instances = std::span<SpriteInstance>(&frame.pages[page_index].geometry_data[offset], count);
 
-        float *geometry_data = this->m_backing_buffer
-                                   ? reinterpret_cast<float *>(this->m_backing_buffer->allocation_info().pMappedData)
-                                   : this->m_geometry_cache.data();
+        m_sprite_count         += count;
+        m_batches.back().count += count;
 
-        const size_t offset = m_sprite_count * Sprite::ATTRIB_COUNT;
-        memcpy(&geometry_data[offset], &sprite, Sprite::ATTRIB_COUNT * sizeof(float));
-        m_sprite_count++;
-        batch.count++;
+        return instances;
     }
 
     void SpriteBatch::reset() {
-        m_texture_indices.clear();
+        // The device is done with the frame slot by now, pages above what it used recently can go
+        auto &frame = m_frames[m_context->frame_index()];
+        if (m_shrink_after_frames > 0 && frame.recorded_frames >= m_shrink_after_frames) {
+            if (frame.peak_page_count < frame.pages.size()) {
+                MILG_DEBUG("Shrinking sprite geometry from {} to {} pages", frame.pages.size(), frame.peak_page_count);
+                frame.pages.resize(frame.peak_page_count);
+            }
+
+            frame.peak_page_count = 0;
+            frame.recorded_frames = 0;
+        }
+
         m_batches.clear();
 
         m_sprite_count = 0;
@@ -457,86 +533,116 @@ namespace milg::graphics {
     }
 
     void SpriteBatch::build_batches(VkCommandBuffer command_buffer) {
+        auto          &frame      = m_frames[m_context->frame_index()];
+        const uint32_t page_count = (m_sprite_count + m_page_capacity - 1) / m_page_capacity;
+
+        frame.peak_page_count = std::max(frame.peak_page_count, page_count);
+        frame.recorded_frames++;
+
         if (m_batches.empty() || m_sprite_count == 0) {
             return;
         }
 
-        if (this->m_backing_buffer) {
+        std::vector<VkBufferMemoryBarrier2> buffer_barriers;
+        for (uint32_t i = 0; i < page_count; i++) {
+            const auto        &page  = frame.pages[i];
+            const uint32_t     count = std::min(m_sprite_count - i * m_page_capacity, m_page_capacity);
+            const VkDeviceSize size  = count * sizeof(SpriteInstance);
+            if (!page.backing_buffer) {
+                // Submitting makes host writes visible, only memory that isn't host coherent needs the flush
+                VK_CHECK(vmaFlushAllocation(m_context->allocator(), page.geometry_buffer->allocation(), 0, size));
+                continue;
+            }
+
+            VK_CHECK(vmaFlushAllocation(m_context->allocator(), page.backing_buffer->allocation(), 0, size));
+
             const VkBufferCopy copy_region = {
                 .srcOffset = 0,
                 .dstOffset = 0,
-                .size      = m_sprite_count * Sprite::ATTRIB_COUNT * sizeof(float),
+                .size      = size,
             };
+            m_context->device_table().vkCmdCopyBuffer(command_buffer, page.backing_buffer->handle(),
+                                                      page.geometry_buffer->handle(), 1, &copy_region);
 
-            m_context->device_table().vkCmdCopyBuffer(command_buffer, this->m_backing_buffer->handle(),
-                                                      this->m_geometry_buffer->handle(), 1, &copy_region);
-        } else {
-            memcpy(this->m_geometry_buffer->allocation_info().pMappedData, this->m_geometry_cache.data(),
-                   m_sprite_count * Sprite::ATTRIB_COUNT * sizeof(float));
+            buffer_barriers.push_back({
+                .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                .pNext               = nullptr,
+                .srcStageMask        = VK_PIPELINE_STAGE_2_COPY_BIT,
+                .srcAccessMask       = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                .dstStageMask        = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+                .dstAccessMask       = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer              = page.geometry_buffer->handle(),
+                .offset              = 0,
+                .size                = size,
+            });
         }
+
+        if (buffer_barriers.empty()) {
+            return;
+        }
+
+        const VkDependencyInfo dependency_info = {
+            .sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .pNext                    = nullptr,
+            .dependencyFlags          = 0,
+            .memoryBarrierCount       = 0,
+            .pMemoryBarriers          = nullptr,
+            .bufferMemoryBarrierCount = static_cast<uint32_t>(buffer_barriers.size()),
+            .pBufferMemoryBarriers    = buffer_barriers.data(),
+            .imageMemoryBarrierCount  = 0,
+            .pImageMemoryBarriers     = nullptr,
+        };
+        m_context->device_table().vkCmdPipelineBarrier2(command_buffer, &dependency_info);
     }
 
     void SpriteBatch::render(VkCommandBuffer command_buffer) {
-        {
-            std::vector<VkWriteDescriptorSet> write_sets;
-            for (const auto &[texture, descriptor] : this->m_texture_indices) {
-                const VkWriteDescriptorSet descriptor_write = {
-                    .sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                    .pNext            = nullptr,
-                    .dstSet           = m_descriptor_set,
-                    .dstBinding       = 1,
-                    .dstArrayElement  = descriptor.index,
-                    .descriptorCount  = 1,
-                    .descriptorType   = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    .pImageInfo       = &descriptor.image_info,
-                    .pBufferInfo      = nullptr,
-                    .pTexelBufferView = nullptr,
-                };
-
-                write_sets.push_back(descriptor_write);
-            }
-            m_context->device_table().vkUpdateDescriptorSets(m_context->device(), write_sets.size(), write_sets.data(),
-                                                             0, nullptr);
-        }
+        const auto           &frame          = m_frames[m_context->frame_index()];
+        const VkDescriptorSet descriptor_set = m_context->descriptor_heap().set();
 
         m_context->device_table().vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
         m_context->device_table().vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                                          m_pipeline_layout, 0, 1, &m_descriptor_set, 0, nullptr);
-
-        size_t   offset           = 0;
-        VkBuffer vertex_buffers[] = {m_geometry_buffer->handle()};
-        m_context->device_table().vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffers[0], &offset);
+                                                          m_pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
 
+        // Batches may span pages, they are split into one draw per page with the page's buffer bound
+        uint32_t bound_page = UINT32_MAX;
         for (const auto &batch : this->m_batches) {
+            if (batch.count == 0) {
+                continue;
+            }
+
             m_context->device_table().vkCmdPushConstants(command_buffer, m_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
                                                          0, sizeof(BatchConstantData), &batch.constant_data);
-            m_context->device_table().vkCmdDraw(command_buffer, 6, batch.count, batch.start_index, 0);
-        }
-    }
 
-    uint32_t SpriteBatch::register_texture(const std::shared_ptr<Texture> &texture) {
-        if (m_texture_indices.find(texture) != m_texture_indices.end()) {
-            return m_texture_indices[texture].index;
+            const uint32_t end   = batch.start_index + batch.count;
+            uint32_t       index = batch.start_index;
+            while (index < end) {
+                const uint32_t page_index = index / m_page_capacity;
+                const uint32_t offset     = index % m_page_capacity;
+                const uint32_t count      = std::min(end - index, m_page_capacity - offset);
+
+                if (page_index != bound_page) {
+                    const VkBuffer     vertex_buffer = frame.pages[page_index].geometry_buffer->handle();
+                    const VkDeviceSize buffer_offset = 0;
+                    m_context->device_table().vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer,
+                                                                     &buffer_offset);
+                    bound_page = page_index;
+                }
+
+                m_context->device_table().vkCmdDraw(command_buffer, 6, count, 0, offset);
+                index += count;
+            }
         }
-
-        uint32_t index             = m_texture_indices.size();
-        m_texture_indices[texture] = {
-            .index = index,
-            .image_info =
-                {
-                    .sampler     = texture->sampler(),
-                    .imageView   = texture->image_view(),
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                },
-        };
-
-        return index;
     }
 
     uint32_t SpriteBatch::capacity() const {
-        return m_capacity;
+        return page_count() * m_page_capacity;
     }
 
+    uint32_t SpriteBatch::page_count() const {
+        return static_cast<uint32_t>(m_frames[m_context->frame_index()].pages.size());
+    }
     uint32_t SpriteBatch::sprite_count() const {
         return m_sprite_count;
     }
@@ -545,15 +651,9 @@ namespace milg::graphics {
         return m_batches.size();
     }
 
-    uint32_t SpriteBatch::texture_count() const {
-        return m_texture_indices.size();
-    }
-
     SpriteBatch::~SpriteBatch() {
         m_context->device_table().vkDestroyPipeline(m_context->device(), m_pipeline, nullptr);
         m_context->device_table().vkDestroyPipelineLayout(m_context->device(), m_pipeline_layout, nullptr);
-        m_context->device_table().vkDestroyDescriptorSetLayout(m_context->device(), m_descriptor_set_layout, nullptr);
-        m_context->device_table().vkDestroyDescriptorPool(m_context->device(), m_descriptor_pool, nullptr);
         m_context->device_table().vkDestroyShaderModule(m_context->device(), m_vertex_shader_module, nullptr);
         m_context->device_table().vkDestroyShaderModule(m_context->device(), m_fragment_shader_module, nullptr);
     }
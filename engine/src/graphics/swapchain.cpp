@@ -3,11 +3,47 @@
 #include <milg/core/logging.hpp>
 #include <milg/core/window.hpp>
 
+#include <algorithm>
 #include <cstdint>
+#include <vector>
+
+namespace {
+    // FIFO is the only mode every surface has to support, so it ends every fallback chain
+    VkPresentModeKHR choose_present_mode(VkPhysicalDevice physical_device, VkSurfaceKHR surface,
+                                         milg::PresentMode present_mode) {
+        uint32_t mode_count = 0u;
+        VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &mode_count, nullptr));
+
+        std::vector<VkPresentModeKHR> supported_modes(mode_count);
+        VK_CHECK(
+            vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &mode_count, supported_modes.data()));
+
+        std::vector<VkPresentModeKHR> candidates;
+        switch (present_mode) {
+        case milg::PresentMode::IMMEDIATE:
+            candidates = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+            break;
+        case milg::PresentMode::MAILBOX:
+            candidates = {VK_PRESENT_MODE_MAILBOX_KHR};
+            break;
+        case milg::PresentMode::FIFO:
+            break;
+        }
+
+        for (const auto candidate : candidates) {
+            if (std::find(supported_modes.begin(), supported_modes.end(), candidate) != supported_modes.end()) {
+                return candidate;
+            }
+        }
+
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+} // namespace
 
 namespace milg::graphics {
     std::shared_ptr<Swapchain> Swapchain::create(const std::unique_ptr<Window>        &window,
-                                                 const std::shared_ptr<VulkanContext> &context) {
+                                                 const std::shared_ptr<VulkanContext> &context,
+                                                 PresentMode                           requested_present_mode) {
         MILG_INFO("Creating swapchain");
         VkSurfaceKHR surface = VK_NULL_HANDLE;
         window->get_swapchain_surface(context, &surface);
@@ -44,7 +80,8 @@ namespace milg::graphics {
         MILG_INFO("Selected surface format: {}, colorspace: {}", string_VkFormat(surface_format.format),
                   string_VkColorSpaceKHR(surface_format.colorSpace));
 
-        VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        VkPresentModeKHR present_mode =
+            choose_present_mode(context->physical_device(), surface, requested_present_mode);
 
         MILG_INFO("Selected present mode: {}", string_VkPresentModeKHR(present_mode));
 
@@ -60,19 +97,37 @@ namespace milg::graphics {
     }
 
     void Swapchain::resize(uint32_t width, uint32_t height) {
-        cleanup();
+        VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_context->physical_device(), m_surface,
+                                                           &m_surface_capabilities));
+
+        // Surfaces that know their size have to be matched exactly, the others take the window size within limits
+        VkExtent2D extent = m_surface_capabilities.currentExtent;
+        if (extent.width == UINT32_MAX) {
+            extent.width  = std::clamp(width, m_surface_capabilities.minImageExtent.width,
+                                       m_surface_capabilities.maxImageExtent.width);
+            extent.height = std::clamp(height, m_surface_capabilities.minImageExtent.height,
+                                       m_surface_capabilities.maxImageExtent.height);
+        }
 
-        VkExtent2D extent = {
-            .width  = width,
-            .height = height,
-        };
+        // Minimized windows report a zero extent, which no swapchain can be created with
+        if (extent.width == 0 || extent.height == 0) {
+            m_out_of_date = true;
+            return;
+        }
+
+        // With only the minimum the application stalls on acquire whenever the presentation engine holds every
+        // image, one more keeps FIFO pipelined
+        uint32_t min_image_count = m_surface_capabilities.minImageCount + 1;
+        if (m_surface_capabilities.maxImageCount != 0) {
+            min_image_count = std::min(min_image_count, m_surface_capabilities.maxImageCount);
+        }
 
         const VkSwapchainCreateInfoKHR swapchain_info = {
             .sType                 = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
             .pNext                 = nullptr,
             .flags                 = 0,
             .surface               = m_surface,
-            .minImageCount         = m_surface_capabilities.minImageCount,
+            .minImageCount         = min_image_count,
             .imageFormat           = m_surface_format.format,
             .imageColorSpace       = m_surface_format.colorSpace,
             .imageExtent           = extent,
@@ -88,8 +143,26 @@ namespace milg::graphics {
             .oldSwapchain          = m_swapchain,
         };
 
+        VkSwapchainKHR swapchain = VK_NULL_HANDLE;
         VK_CHECK(m_context->device_table().vkCreateSwapchainKHR(m_context->device(), &swapchain_info, nullptr,
-                                                                &m_swapchain));
+                                                                &swapchain));
+
+        // Frames in flight may still use the old swapchain and its views, they're destroyed once the last frame that
+        // acquired from it finished
+        if (m_swapchain != VK_NULL_HANDLE) {
+            RetiredSwapchain retired = {
+                .swapchain   = m_swapchain,
+                .views       = {},
+                .frame_value = m_frame_value,
+            };
+            for (const auto &image : m_images) {
+                retired.views.push_back(image.view);
+            }
+            m_retired.push_back(std::move(retired));
+        }
+        m_images.clear();
+        m_swapchain   = swapchain;
+        m_out_of_date = false;
 
         uint32_t image_count = 0u;
         VK_CHECK(
@@ -137,21 +210,106 @@ namespace milg::graphics {
             });
         }
 
-        m_extent.width  = width;
-        m_extent.height = height;
+        m_extent = extent;
+    }
+
+    void Swapchain::set_present_mode(PresentMode present_mode) {
+        const VkPresentModeKHR new_present_mode =
+            choose_present_mode(m_context->physical_device(), m_surface, present_mode);
+        if (new_present_mode == m_present_mode) {
+            return;
+        }
+
+        MILG_INFO("Selected present mode: {}", string_VkPresentModeKHR(new_present_mode));
+
+        m_present_mode = new_present_mode;
+        resize(m_extent.width, m_extent.height);
+    }
+
+    VkPresentModeKHR Swapchain::present_mode() const {
+        return m_present_mode;
+    }
+
+    uint64_t Swapchain::present_id() const {
+        return m_present_id;
     }
 
-    uint32_t Swapchain::acquire_next_image(VkSemaphore semaphore, VkFence fence) {
-        (vkAcquireNextImageKHR(m_context->device(), m_swapchain, UINT64_MAX, semaphore, fence, &m_image_index));
+    bool Swapchain::wait_for_present(uint64_t present_id, uint64_t timeout_ns) const {
+        if (!m_context->supports_present_wait()) {
+            return false;
+        }
+
+        if (present_id == 0) {
+            return true;
+        }
+
+        const VkResult result = m_context->device_table().vkWaitForPresentKHR(m_context->device(), m_swapchain,
+                                                                              present_id, timeout_ns);
+        return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+    }
+
+    void Swapchain::release_retired(uint64_t completed_frame_value) {
+        std::erase_if(m_retired, [this, completed_frame_value](const RetiredSwapchain &retired) {
+            if (retired.frame_value > completed_frame_value) {
+                return false;
+            }
+
+            for (const auto view : retired.views) {
+                vkDestroyImageView(m_context->device(), view, nullptr);
+            }
+            vkDestroySwapchainKHR(m_context->device(), retired.swapchain, nullptr);
+
+            return true;
+        });
+    }
+
+    std::optional<uint32_t> Swapchain::acquire_next_image(VkSemaphore semaphore, uint64_t frame_value) {
+        // A suboptimal swapchain still presented last frame, it's replaced before anything else is acquired from it
+        if (m_out_of_date) {
+            resize(m_extent.width, m_extent.height);
+            if (m_out_of_date) {
+                return std::nullopt;
+            }
+        }
+
+        m_frame_value = frame_value;
+
+        VkResult result = vkAcquireNextImageKHR(m_context->device(), m_swapchain, UINT64_MAX, semaphore,
+                                                VK_NULL_HANDLE, &m_image_index);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            // Nothing was acquired and the semaphore is left unsignalled, so it can be reused right away
+            resize(m_extent.width, m_extent.height);
+            if (m_out_of_date) {
+                return std::nullopt;
+            }
+            result = vkAcquireNextImageKHR(m_context->device(), m_swapchain, UINT64_MAX, semaphore, VK_NULL_HANDLE,
+                                           &m_image_index);
+        }
+
+        if (result == VK_SUBOPTIMAL_KHR) {
+            m_out_of_date = true;
+        } else {
+            VK_CHECK(result);
+        }
+
         m_images[m_image_index].layout = VK_IMAGE_LAYOUT_UNDEFINED;
 
         return m_image_index;
     }
 
     void Swapchain::present_image(VkQueue queue, VkSemaphore semaphore) {
+        // Ids only matter to present wait, they increase by one per present
+        const uint64_t       present_id      = m_present_id + 1;
+        const VkPresentIdKHR present_id_info = {
+            .sType          = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+            .pNext          = nullptr,
+            .swapchainCount = 1,
+            .pPresentIds    = &present_id,
+        };
+
         VkPresentInfoKHR present_info = {
             .sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-            .pNext              = nullptr,
+            .pNext              = m_context->supports_present_wait() ? &present_id_info : nullptr,
             .waitSemaphoreCount = 1,
             .pWaitSemaphores    = &semaphore,
             .swapchainCount     = 1,
@@ -160,7 +318,13 @@ namespace milg::graphics {
             .pResults           = nullptr,
         };
 
-        (vkQueuePresentKHR(queue, &present_info));
+        const VkResult result = vkQueuePresentKHR(queue, &present_info);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            m_out_of_date = true;
+        } else {
+            VK_CHECK(result);
+        }
+        m_present_id = present_id;
     }
 
     void Swapchain::transition_current_image(VkCommandBuffer command_buffer, VkImageLayout new_layout) {
@@ -228,6 +392,7 @@ namespace milg::graphics {
 
     Swapchain::~Swapchain() {
         cleanup();
+        release_retired(UINT64_MAX);
 
         vkDestroySwapchainKHR(m_context->device(), m_swapchain, nullptr);
         vkDestroySurfaceKHR(m_context->instance(), m_surface, nullptr);
@@ -1,17 +1,120 @@
 #include <milg/core/asset.hpp>
 #include <milg/core/error.hpp>
 #include <milg/graphics/texture.hpp>
+#include <milg/graphics/upload_queue.hpp>
 
 #include <milg/core/logging.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define MILG_TEXTURE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+    const size_t KTX2_HEADER_SIZE      = 80;
+    const size_t KTX2_LEVEL_INDEX_SIZE = 24;
+
+    template <typename T> T read_value(ByteView bytes, size_t offset) {
+        T value = {};
+        memcpy(&value, bytes.data() + offset, sizeof(T));
+        return value;
+    }
+
+    // Bytes per 4x4 block of the block compressed formats KTX2 textures may use, 0 for any other format
+    uint32_t bc_block_size(VkFormat format) {
+        switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+            return 8;
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+#ifdef MILG_TEXTURE_SSE2
+    // Sums of the 2x2 blocks covered by four RGBA8 texels of two rows, as two texels of 16 bit channels
+    __m128i box_sum_rgba8(__m128i top, __m128i bottom) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i low  = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+        const __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+
+        return _mm_unpacklo_epi64(_mm_add_epi16(low, _mm_srli_si128(low, 8)),
+                                  _mm_add_epi16(high, _mm_srli_si128(high, 8)));
+    }
+#endif
+
+    // 2x2 box filter over RGBA8 texels, odd edges reuse the last row/column
+    void downsample_rgba8(const std::byte *src, uint32_t src_width, uint32_t src_height, std::byte *dst) {
+        const uint32_t dst_width  = std::max(src_width / 2, 1u);
+        const uint32_t dst_height = std::max(src_height / 2, 1u);
+
+        for (uint32_t y = 0; y < dst_height; y++) {
+            const auto *row0 = src + static_cast<size_t>(std::min(y * 2, src_height - 1)) * src_width * 4;
+            const auto *row1 = src + static_cast<size_t>(std::min(y * 2 + 1, src_height - 1)) * src_width * 4;
+            auto       *out  = dst + static_cast<size_t>(y) * dst_width * 4;
+
+            uint32_t x = 0;
+#ifdef MILG_TEXTURE_SSE2
+            // Four output texels per iteration, summed in 16 bit lanes and rounded once like the scalar path
+            const __m128i bias = _mm_set1_epi16(2);
+            for (; (x + 4) * 2 <= src_width; x += 4) {
+                const __m128i top0    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8));
+                const __m128i top1    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8 + 16));
+                const __m128i bottom0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8));
+                const __m128i bottom1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8 + 16));
+
+                const __m128i sum0 = _mm_srli_epi16(_mm_add_epi16(box_sum_rgba8(top0, bottom0), bias), 2);
+                const __m128i sum1 = _mm_srli_epi16(_mm_add_epi16(box_sum_rgba8(top1, bottom1), bias), 2);
+
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x * 4), _mm_packus_epi16(sum0, sum1));
+            }
+#endif
+            for (; x < dst_width; x++) {
+                const uint32_t x0 = std::min(x * 2, src_width - 1) * 4;
+                const uint32_t x1 = std::min(x * 2 + 1, src_width - 1) * 4;
+
+                for (uint32_t c = 0; c < 4; c++) {
+                    uint32_t sum = 0;
+                    sum += std::to_integer<uint32_t>(row0[x0 + c]) + std::to_integer<uint32_t>(row0[x1 + c]);
+                    sum += std::to_integer<uint32_t>(row1[x0 + c]) + std::to_integer<uint32_t>(row1[x1 + c]);
+
+                    out[x * 4 + c] = static_cast<std::byte>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+} // namespace
 
 namespace milg::graphics {
-    std::shared_ptr<Texture> Texture::load_from_data(const std::shared_ptr<VulkanContext> &context,
-                                                     const TextureCreateInfo &create_info, const Bytes &bytes) {
+    std::optional<TextureData> Texture::decode(ByteView bytes) {
         int32_t  width    = 0;
         int32_t  height   = 0;
         int32_t  channels = 0;
@@ -20,25 +123,143 @@ namespace milg::graphics {
 
         if (!data) {
             MILG_ERROR("Failed to load texture data: {}", stbi_failure_reason());
+            return std::nullopt;
+        }
+
+        auto pixels = reinterpret_cast<const std::byte *>(data);
+        auto result = TextureData{
+            .width  = static_cast<uint32_t>(width),
+            .height = static_cast<uint32_t>(height),
+            .pixels = Bytes(pixels, pixels + static_cast<size_t>(width * height) * 4),
+        };
+
+        stbi_image_free(data);
+
+        return result;
+    }
+
+    std::optional<TextureData> Texture::decode_ktx2(ByteView bytes) {
+        if (bytes.size() < KTX2_HEADER_SIZE || memcmp(bytes.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+            return std::nullopt;
+        }
+
+        const auto format           = static_cast<VkFormat>(read_value<uint32_t>(bytes, 12));
+        const auto width            = read_value<uint32_t>(bytes, 20);
+        const auto height           = read_value<uint32_t>(bytes, 24);
+        const auto depth            = read_value<uint32_t>(bytes, 28);
+        const auto layer_count      = read_value<uint32_t>(bytes, 32);
+        const auto face_count       = read_value<uint32_t>(bytes, 36);
+        const auto level_count      = std::max(read_value<uint32_t>(bytes, 40), 1u);
+        const auto supercompression = read_value<uint32_t>(bytes, 44);
+
+        // Only plain 2D block compressed images are produced by the texture compiler
+        const uint32_t block_size = bc_block_size(format);
+        if (block_size == 0 || depth > 1 || layer_count > 1 || face_count != 1 || supercompression != 0) {
+            MILG_ERROR("Unsupported KTX2 texture: format {}, {} layers, {} faces, supercompression {}",
+                       string_VkFormat(format), layer_count, face_count, supercompression);
+            return std::nullopt;
+        }
+
+        if (width == 0 || height == 0 || level_count > static_cast<uint32_t>(std::bit_width(std::max(width, height)))) {
+            MILG_ERROR("Invalid KTX2 extent {}x{} with {} levels", width, height, level_count);
+            return std::nullopt;
+        }
+
+        if (bytes.size() < KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_SIZE * level_count) {
+            MILG_ERROR("Truncated KTX2 level index");
+            return std::nullopt;
+        }
+
+        // Levels are uploaded from one buffer, tightly packed with level 0 first
+        auto result = TextureData{
+            .width      = width,
+            .height     = height,
+            .format     = format,
+            .mip_levels = level_count,
+        };
+
+        for (uint32_t level = 0; level < level_count; level++) {
+            const size_t index  = KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_SIZE * level;
+            const auto   offset = read_value<uint64_t>(bytes, index);
+            const auto   length = read_value<uint64_t>(bytes, index + 8);
+
+            if (offset > bytes.size() || length > bytes.size() - offset) {
+                MILG_ERROR("KTX2 level {} is out of bounds", level);
+                return std::nullopt;
+            }
+
+            // The upload copies whole levels, a short one would read past the staging data
+            const uint64_t level_width  = std::max(width >> level, 1u);
+            const uint64_t level_height = std::max(height >> level, 1u);
+            const uint64_t expected     = (level_width + 3) / 4 * ((level_height + 3) / 4) * block_size;
+            if (length != expected) {
+                MILG_ERROR("KTX2 level {} has {} bytes, expected {}", level, length, expected);
+                return std::nullopt;
+            }
+
+            result.level_offsets.push_back(result.pixels.size());
+            result.pixels.insert(result.pixels.end(), bytes.begin() + offset, bytes.begin() + offset + length);
+        }
+
+        return result;
+    }
+
+    std::shared_ptr<Texture> Texture::load_from_data(const std::shared_ptr<VulkanContext> &context,
+                                                     const TextureCreateInfo &create_info, ByteView bytes) {
+        auto data = Texture::decode(bytes);
+        if (!data.has_value()) {
             return nullptr;
         }
 
+        return Texture::create_from_pixels(context, create_info, *data);
+    }
+
+    std::shared_ptr<Texture> Texture::create_from_pixels(const std::shared_ptr<VulkanContext> &context,
+                                                         const TextureCreateInfo              &create_info,
+                                                         const TextureData                    &data) {
+        const uint32_t width       = data.width;
+        const uint32_t height      = data.height;
+        const bool     precompiled = data.format != VK_FORMAT_UNDEFINED;
+        const VkFormat format      = precompiled ? data.format : create_info.format;
+
+        uint32_t mip_levels = 1;
+        if (precompiled) {
+            mip_levels = data.mip_levels;
+        } else if (create_info.generate_mips) {
+            mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+        }
+
+        VkFormatProperties format_properties = {};
+        vkGetPhysicalDeviceFormatProperties(context->physical_device(), format, &format_properties);
+
+        const VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                                   VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        const bool blit_mips = !precompiled && mip_levels > 1 &&
+                               (format_properties.optimalTilingFeatures & blit_features) == blit_features;
+
         VkImageUsageFlags usage_flags = create_info.usage;
         usage_flags |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        if (blit_mips) {
+            usage_flags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+        if (precompiled) {
+            // Block compressed formats can't be written from shaders
+            usage_flags &= ~VK_IMAGE_USAGE_STORAGE_BIT;
+        }
 
         const VkImageCreateInfo image_create_info = {
             .sType     = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
             .pNext     = nullptr,
             .flags     = 0,
             .imageType = VK_IMAGE_TYPE_2D,
-            .format    = create_info.format,
+            .format    = format,
             .extent =
                 {
                     .width  = static_cast<uint32_t>(width),
                     .height = static_cast<uint32_t>(height),
                     .depth  = 1,
                 },
-            .mipLevels             = 1,
+            .mipLevels             = mip_levels,
             .arrayLayers           = 1,
             .samples               = VK_SAMPLE_COUNT_1_BIT,
             .tiling                = VK_IMAGE_TILING_OPTIMAL,
@@ -66,105 +287,44 @@ namespace milg::graphics {
         VK_CHECK(vmaCreateImage(context->allocator(), &image_create_info, &allocation_create_info, &image, &allocation,
                                 &allocation_info));
 
-        const VkBufferCreateInfo staging_buffer_create_info = {
-            .sType                 = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .pNext                 = nullptr,
-            .flags                 = 0,
-            .size                  = static_cast<size_t>(width * height * 4),
-            .usage                 = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            .sharingMode           = VK_SHARING_MODE_EXCLUSIVE,
-            .queueFamilyIndexCount = 0,
-            .pQueueFamilyIndices   = nullptr,
-        };
-
-        const VmaAllocationCreateInfo staging_allocation_create_info = {
-            .flags          = 0,
-            .usage          = VMA_MEMORY_USAGE_CPU_ONLY,
-            .requiredFlags  = 0,
-            .preferredFlags = 0,
-            .memoryTypeBits = 0,
-            .pool           = VK_NULL_HANDLE,
-            .pUserData      = nullptr,
-            .priority       = 0.0f,
+        const VkExtent3D extent = {
+            .width  = width,
+            .height = height,
+            .depth  = 1,
         };
 
-        VkBuffer          staging_buffer          = VK_NULL_HANDLE;
-        VmaAllocation     staging_allocation      = VK_NULL_HANDLE;
-        VmaAllocationInfo staging_allocation_info = {};
-        VK_CHECK(vmaCreateBuffer(context->allocator(), &staging_buffer_create_info, &staging_allocation_create_info,
-                                 &staging_buffer, &staging_allocation, &staging_allocation_info));
-
-        void *staging_data = nullptr;
-        VK_CHECK(vmaMapMemory(context->allocator(), staging_allocation, &staging_data));
-        memcpy(staging_data, data, static_cast<size_t>(width * height) * 4);
-        vmaUnmapMemory(context->allocator(), staging_allocation);
-
-        stbi_image_free(data);
-
-        VkCommandBuffer command_buffer = context->begin_single_time_commands();
-
-        VkImageMemoryBarrier barrier = {
-            .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .pNext               = nullptr,
-            .srcAccessMask       = 0,
-            .dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED,
-            .newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image               = image,
-            .subresourceRange =
-                {
-                    .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .baseMipLevel   = 0,
-                    .levelCount     = 1,
-                    .baseArrayLayer = 0,
-                    .layerCount     = 1,
-                },
-        };
-
-        context->device_table().vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                                                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-                                                     &barrier);
-
-        const VkBufferImageCopy copy_region = {
-            .bufferOffset      = 0,
-            .bufferRowLength   = 0,
-            .bufferImageHeight = 0,
-            .imageSubresource =
-                {
-                    .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .mipLevel       = 0,
-                    .baseArrayLayer = 0,
-                    .layerCount     = 1,
-                },
-            .imageOffset =
-                {
-                    .x = 0,
-                    .y = 0,
-                    .z = 0,
-                },
-            .imageExtent =
-                {
-                    .width  = static_cast<uint32_t>(width),
-                    .height = static_cast<uint32_t>(height),
-                    .depth  = 1,
-                },
-        };
-
-        context->device_table().vkCmdCopyBufferToImage(command_buffer, staging_buffer, image,
-                                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
-
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        context->device_table().vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
-                                                     1, &barrier);
-        context->end_single_time_commands(command_buffer);
-        vmaDestroyBuffer(context->allocator(), staging_buffer, staging_allocation);
+        // The copy is batched with the other pending uploads, graphics work submitted after the next flush sees it
+        if (precompiled) {
+            context->upload_queue().upload_image(image, extent, mip_levels, data.level_offsets, data.pixels.data(),
+                                                 data.pixels.size());
+        } else if (mip_levels == 1) {
+            context->upload_queue().upload_image(image, extent, data.pixels.data(), data.pixels.size());
+        } else if (blit_mips) {
+            const VkDeviceSize level_offset = 0;
+
+            context->upload_queue().upload_image(image, extent, mip_levels, {&level_offset, 1}, data.pixels.data(),
+                                                 data.pixels.size());
+        } else {
+            // The format can't be blitted, build the chain on the CPU and upload every level
+            std::vector<VkDeviceSize> level_offsets = {0};
+            Bytes                     mip_chain     = data.pixels;
+
+            for (uint32_t level = 1; level < mip_levels; level++) {
+                const uint32_t src_width  = std::max(width >> (level - 1), 1u);
+                const uint32_t src_height = std::max(height >> (level - 1), 1u);
+                const size_t   dst_size   = static_cast<size_t>(std::max(width >> level, 1u)) *
+                                          std::max(height >> level, 1u) * 4;
+                const size_t src_offset = level_offsets.back();
+
+                level_offsets.push_back(mip_chain.size());
+                mip_chain.resize(mip_chain.size() + dst_size);
+                downsample_rgba8(mip_chain.data() + src_offset, src_width, src_height,
+                                 mip_chain.data() + level_offsets.back());
+            }
+
+            context->upload_queue().upload_image(image, extent, mip_levels, level_offsets, mip_chain.data(),
+                                                 mip_chain.size());
+        }
 
         VkImageLayout image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
@@ -174,7 +334,7 @@ namespace milg::graphics {
             .flags    = 0,
             .image    = image,
             .viewType = VK_IMAGE_VIEW_TYPE_2D,
-            .format   = create_info.format,
+            .format   = format,
             .components =
                 {
                     .r = VK_COMPONENT_SWIZZLE_IDENTITY,
@@ -186,7 +346,7 @@ namespace milg::graphics {
                 {
                     .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
                     .baseMipLevel   = 0,
-                    .levelCount     = 1,
+                    .levelCount     = mip_levels,
                     .baseArrayLayer = 0,
                     .layerCount     = 1,
                 },
@@ -211,7 +371,7 @@ namespace milg::graphics {
             .compareEnable           = VK_FALSE,
             .compareOp               = VK_COMPARE_OP_ALWAYS,
             .minLod                  = 0.0f,
-            .maxLod                  = 0.0f,
+            .maxLod                  = static_cast<float>(mip_levels),
             .borderColor             = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
             .unnormalizedCoordinates = VK_FALSE,
         };
@@ -230,7 +390,7 @@ namespace milg::graphics {
         texture->m_handle          = image;
         texture->m_image_view      = image_view;
         texture->m_sampler         = sampler;
-        texture->m_format          = create_info.format;
+        texture->m_format          = format;
         texture->m_descriptor      = descriptor_image_info;
         texture->m_allocation      = allocation;
         texture->m_allocation_info = allocation_info;
@@ -238,39 +398,57 @@ namespace milg::graphics {
         texture->m_width           = width;
         texture->m_height          = height;
         texture->m_depth           = 1;
-        texture->m_mip_levels      = 1;
+        texture->m_mip_levels      = mip_levels;
         texture->m_layer_count     = 1;
 
+        // Heap slots only exist for the usages the image was created with. Shaders write storage images one level
+        // at a time, so mip mapped ones only get a sampler slot
+        if (usage_flags & VK_IMAGE_USAGE_SAMPLED_BIT) {
+            texture->m_descriptor_index = context->descriptor_heap().allocate_texture(descriptor_image_info);
+        }
+        if ((usage_flags & VK_IMAGE_USAGE_STORAGE_BIT) && mip_levels == 1) {
+            texture->m_storage_descriptor_index = context->descriptor_heap().allocate_storage_image({
+                .sampler     = VK_NULL_HANDLE,
+                .imageView   = image_view,
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+            });
+        }
+
         return texture;
     }
 
+    namespace {
+        VkImageCreateInfo make_image_info(const TextureCreateInfo &create_info, uint32_t width, uint32_t height) {
+            return {
+                .sType     = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .pNext     = nullptr,
+                .flags     = 0,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format    = create_info.format,
+                .extent =
+                    {
+                        .width  = static_cast<uint32_t>(width),
+                        .height = static_cast<uint32_t>(height),
+                        .depth  = 1,
+                    },
+                .mipLevels             = 1,
+                .arrayLayers           = 1,
+                .samples               = VK_SAMPLE_COUNT_1_BIT,
+                .tiling                = VK_IMAGE_TILING_OPTIMAL,
+                .usage                 = create_info.usage,
+                .sharingMode           = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices   = nullptr,
+                .initialLayout         = VK_IMAGE_LAYOUT_UNDEFINED,
+            };
+        }
+    } // namespace
+
     std::shared_ptr<Texture> Texture::create(const std::shared_ptr<VulkanContext> &context,
                                              const TextureCreateInfo &create_info, uint32_t width, uint32_t height) {
         MILG_INFO("Creating texture {}x{} with format {}", width, height, string_VkFormat(create_info.format));
 
-        VkImageUsageFlags       usage_flags       = create_info.usage;
-        const VkImageCreateInfo image_create_info = {
-            .sType     = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-            .pNext     = nullptr,
-            .flags     = 0,
-            .imageType = VK_IMAGE_TYPE_2D,
-            .format    = create_info.format,
-            .extent =
-                {
-                    .width  = static_cast<uint32_t>(width),
-                    .height = static_cast<uint32_t>(height),
-                    .depth  = 1,
-                },
-            .mipLevels             = 1,
-            .arrayLayers           = 1,
-            .samples               = VK_SAMPLE_COUNT_1_BIT,
-            .tiling                = VK_IMAGE_TILING_OPTIMAL,
-            .usage                 = usage_flags,
-            .sharingMode           = VK_SHARING_MODE_EXCLUSIVE,
-            .queueFamilyIndexCount = 0,
-            .pQueueFamilyIndices   = nullptr,
-            .initialLayout         = VK_IMAGE_LAYOUT_UNDEFINED,
-        };
+        const VkImageCreateInfo image_create_info = make_image_info(create_info, width, height);
 
         const VmaAllocationCreateInfo allocation_create_info = {
             .flags          = 0,
@@ -289,6 +467,48 @@ namespace milg::graphics {
         VK_CHECK(vmaCreateImage(context->allocator(), &image_create_info, &allocation_create_info, &image, &allocation,
                                 &allocation_info));
 
+        return create_from_image(context, create_info, image, allocation, allocation_info, width, height);
+    }
+
+    std::shared_ptr<Texture> Texture::create_aliased(const std::shared_ptr<VulkanContext> &context,
+                                                     const TextureCreateInfo &create_info, uint32_t width,
+                                                     uint32_t height, VmaAllocation memory, VkDeviceSize offset) {
+        const VkImageCreateInfo image_create_info = make_image_info(create_info, width, height);
+
+        VkImage image = VK_NULL_HANDLE;
+        VK_CHECK(vmaCreateAliasingImage2(context->allocator(), memory, offset, &image_create_info, &image));
+
+        // The memory stays with its owner, the texture only destroys the image
+        return create_from_image(context, create_info, image, VK_NULL_HANDLE, {}, width, height);
+    }
+
+    VkMemoryRequirements Texture::memory_requirements(const std::shared_ptr<VulkanContext> &context,
+                                                      const TextureCreateInfo &create_info, uint32_t width,
+                                                      uint32_t height) {
+        const VkImageCreateInfo               image_create_info = make_image_info(create_info, width, height);
+        const VkDeviceImageMemoryRequirements requirements_info = {
+            .sType       = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS,
+            .pNext       = nullptr,
+            .pCreateInfo = &image_create_info,
+            .planeAspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        };
+
+        VkMemoryRequirements2 requirements = {
+            .sType              = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+            .pNext              = nullptr,
+            .memoryRequirements = {},
+        };
+        context->device_table().vkGetDeviceImageMemoryRequirements(context->device(), &requirements_info,
+                                                                   &requirements);
+
+        return requirements.memoryRequirements;
+    }
+
+    std::shared_ptr<Texture> Texture::create_from_image(const std::shared_ptr<VulkanContext> &context,
+                                                        const TextureCreateInfo &create_info, VkImage image,
+                                                        VmaAllocation            allocation,
+                                                        const VmaAllocationInfo &allocation_info, uint32_t width,
+                                                        uint32_t height) {
         const VkImageViewCreateInfo image_view_info = {
             .sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
             .pNext    = nullptr,
@@ -362,20 +582,87 @@ namespace milg::graphics {
         texture->m_mip_levels      = 1;
         texture->m_layer_count     = 1;
 
+        // Heap slots only exist for the usages the image was created with
+        if (create_info.usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+            texture->m_descriptor_index = context->descriptor_heap().allocate_texture(descriptor_image_info);
+        }
+        if (create_info.usage & VK_IMAGE_USAGE_STORAGE_BIT) {
+            texture->m_storage_descriptor_index = context->descriptor_heap().allocate_storage_image({
+                .sampler     = VK_NULL_HANDLE,
+                .imageView   = image_view,
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+            });
+        }
+
         return texture;
     }
 
     Texture::~Texture() {
-        vmaDestroyImage(m_context->allocator(), m_handle, m_allocation);
-        m_context->device_table().vkDestroySampler(m_context->device(), m_sampler, nullptr);
-        m_context->device_table().vkDestroyImageView(m_context->device(), m_image_view, nullptr);
+        m_context->descriptor_heap().free_texture(m_descriptor_index);
+        m_context->descriptor_heap().free_storage_image(m_storage_descriptor_index);
+
+        // Frames in flight may still sample the image through the heap, it goes away together with its slots
+        const VulkanContext *context = m_context.get();
+        m_context->descriptor_heap().retire_resource(
+            [context, handle = m_handle, allocation = m_allocation, sampler = m_sampler, image_view = m_image_view] {
+                vmaDestroyImage(context->allocator(), handle, allocation);
+                context->device_table().vkDestroySampler(context->device(), sampler, nullptr);
+                context->device_table().vkDestroyImageView(context->device(), image_view, nullptr);
+            });
+    }
+
+    void Texture::swap(Texture &other) {
+        std::swap(m_handle, other.m_handle);
+        std::swap(m_image_view, other.m_image_view);
+        std::swap(m_sampler, other.m_sampler);
+        std::swap(m_format, other.m_format);
+        std::swap(m_descriptor, other.m_descriptor);
+        std::swap(m_allocation, other.m_allocation);
+        std::swap(m_allocation_info, other.m_allocation_info);
+        std::swap(m_layout, other.m_layout);
+        std::swap(m_width, other.m_width);
+        std::swap(m_height, other.m_height);
+        std::swap(m_depth, other.m_depth);
+        std::swap(m_mip_levels, other.m_mip_levels);
+        std::swap(m_layer_count, other.m_layer_count);
+
+        // The slots stay with their textures, so indices already handed out now sample the swapped in image
+        if (m_descriptor_index != DescriptorHeap::INVALID_INDEX) {
+            m_context->descriptor_heap().write_texture(m_descriptor_index, m_descriptor);
+        }
+        if (other.m_descriptor_index != DescriptorHeap::INVALID_INDEX) {
+            other.m_context->descriptor_heap().write_texture(other.m_descriptor_index, other.m_descriptor);
+        }
+        if (m_storage_descriptor_index != DescriptorHeap::INVALID_INDEX) {
+            m_context->descriptor_heap().write_storage_image(m_storage_descriptor_index, {
+                .sampler     = VK_NULL_HANDLE,
+                .imageView   = m_image_view,
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+            });
+        }
+        if (other.m_storage_descriptor_index != DescriptorHeap::INVALID_INDEX) {
+            other.m_context->descriptor_heap().write_storage_image(other.m_storage_descriptor_index, {
+                .sampler     = VK_NULL_HANDLE,
+                .imageView   = other.m_image_view,
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+            });
+        }
     }
 
     void Texture::transition_layout(VkCommandBuffer command_buffer, VkImageLayout new_layout) {
-        m_context->transition_image_layout(command_buffer, m_handle, m_layout, new_layout);
+        m_context->transition_image_layout(command_buffer, m_handle, m_layout, new_layout, m_mip_levels);
+        m_layout = new_layout;
+    }
+
+    void Texture::transition_layout(BarrierBatch &batch, VkImageLayout new_layout) {
+        batch.transition(m_handle, m_layout, new_layout, m_mip_levels);
         m_layout = new_layout;
     }
 
+    void Texture::set_layout(VkImageLayout layout) {
+        m_layout = layout;
+    }
+
     void Texture::blit_from(const std::shared_ptr<Texture> &from, VkCommandBuffer command_buffer) {
         VkImageBlit2 blit_region = {
             .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
@@ -445,6 +732,14 @@ namespace milg::graphics {
         return m_descriptor;
     }
 
+    uint32_t Texture::descriptor_index() const {
+        return m_descriptor_index;
+    }
+
+    uint32_t Texture::storage_descriptor_index() const {
+        return m_storage_descriptor_index;
+    }
+
     VmaAllocation Texture::allocation() const {
         return m_allocation;
     }
@@ -475,23 +770,70 @@ namespace milg::graphics {
 } // namespace milg::graphics
 
 namespace milg::graphics {
-    Texture::Loader::Loader(std::weak_ptr<VulkanContext> ctx) : ctx(ctx) {
+    Texture::Loader::Loader(std::weak_ptr<VulkanContext> ctx)
+        : Loader(ctx, {
+                          .format     = VK_FORMAT_R8G8B8A8_UNORM,
+                          .usage      = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                          .min_filter = VK_FILTER_NEAREST,
+                          .mag_filter = VK_FILTER_NEAREST,
+                      }) {
     }
 
-    auto Texture::Loader::load(std::ifstream &stream) -> milg::LoadResult<void> {
-        const TextureCreateInfo texture_info = {
-            .format     = VK_FORMAT_R8G8B8A8_UNORM,
-            .usage      = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
-            .min_filter = VK_FILTER_NEAREST,
-            .mag_filter = VK_FILTER_NEAREST,
-        };
+    Texture::Loader::Loader(std::weak_ptr<VulkanContext> ctx, const TextureCreateInfo &create_info)
+        : ctx(ctx), create_info(create_info) {
+    }
 
+    // Prefers the precompiled KTX2 next to the source image when the device can sample block compressed formats
+    auto Texture::Loader::candidates(const std::filesystem::path &path) const -> std::vector<std::filesystem::path> {
+        auto ctx = this->ctx.lock();
+        if (ctx == nullptr || !ctx->supports_bc_compression() || path.extension() == ".ktx2") {
+            return {path};
+        }
+
+        return {std::filesystem::path(path).replace_extension(".ktx2"), path};
+    }
+
+    auto Texture::Loader::decode(ByteView bytes) -> milg::LoadResult<void> {
+        auto data = Asset::Loader::get_current_path().extension() == ".ktx2" ? Texture::decode_ktx2(bytes)
+                                                                               : Texture::decode(bytes);
+        if (!data.has_value()) {
+            return nullptr;
+        }
+
+        return std::make_shared<TextureData>(std::move(*data));
+    }
+
+    auto Texture::Loader::finalize(const std::shared_ptr<void> &decoded) -> milg::LoadResult<void> {
         if (auto ctx = this->ctx.lock()) {
-            return Texture::load_from_data(ctx, texture_info, Asset::Loader::read_stream(stream));
+            return Texture::create_from_pixels(ctx, this->create_info, *std::static_pointer_cast<TextureData>(decoded));
         } else {
             throw milg::vulkan_context_error::destroyed();
         }
 
         return nullptr;
     }
+
+    // Image creation and the upload go through the context's queue, which is only used from the main thread
+    bool Texture::Loader::finalize_on_main_thread() const {
+        return true;
+    }
+
+    auto Texture::Loader::measure(const std::shared_ptr<void> &asset) const -> AssetMemory {
+        return {.gpu = std::static_pointer_cast<Texture>(asset)->allocation_info().size};
+    }
+
+    // The existing texture keeps its descriptor heap slot and the slot is rewritten with the new image, users holding
+    // the texture or its index pick it up without doing anything. The old image is destroyed with the fresh texture
+    // once the swap returns
+    bool Texture::Loader::reload(const std::shared_ptr<void> &existing, const std::shared_ptr<void> &fresh) {
+        auto ctx = this->ctx.lock();
+        if (ctx == nullptr) {
+            return false;
+        }
+
+        ctx->device_table().vkDeviceWaitIdle(ctx->device());
+        std::static_pointer_cast<Texture>(existing)->swap(*std::static_pointer_cast<Texture>(fresh));
+
+        return true;
+    }
 } // namespace milg::graphics
@@ -0,0 +1,598 @@
+#include <milg/graphics/upload_queue.hpp>
+
+#include <milg/core/logging.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    VkBuffer create_staging_buffer(const milg::graphics::VulkanContext &context, VkDeviceSize size,
+                                   VmaAllocation *allocation, void **mapped) {
+        const VkBufferCreateInfo buffer_create_info = {
+            .sType                 = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext                 = nullptr,
+            .flags                 = 0,
+            .size                  = size,
+            .usage                 = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode           = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices   = nullptr,
+        };
+
+        const VmaAllocationCreateInfo allocation_create_info = {
+            .flags          = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage          = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+            .requiredFlags  = 0,
+            .preferredFlags = 0,
+            .memoryTypeBits = 0,
+            .pool           = VK_NULL_HANDLE,
+            .pUserData      = nullptr,
+            .priority       = 0.0f,
+        };
+
+        VkBuffer          buffer          = VK_NULL_HANDLE;
+        VmaAllocationInfo allocation_info = {};
+        VK_CHECK(vmaCreateBuffer(context.allocator(), &buffer_create_info, &allocation_create_info, &buffer, allocation,
+                                 &allocation_info));
+
+        *mapped = allocation_info.pMappedData;
+
+        return buffer;
+    }
+
+    void pipeline_barrier(const VolkDeviceTable &device_table, VkCommandBuffer command_buffer,
+                          const VkImageMemoryBarrier2 *image_barrier, const VkBufferMemoryBarrier2 *buffer_barrier) {
+        const VkDependencyInfo dependency_info = {
+            .sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .pNext                    = nullptr,
+            .dependencyFlags          = 0,
+            .memoryBarrierCount       = 0,
+            .pMemoryBarriers          = nullptr,
+            .bufferMemoryBarrierCount = buffer_barrier != nullptr ? 1u : 0u,
+            .pBufferMemoryBarriers    = buffer_barrier,
+            .imageMemoryBarrierCount  = image_barrier != nullptr ? 1u : 0u,
+            .pImageMemoryBarriers     = image_barrier,
+        };
+
+        device_table.vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+    }
+} // namespace
+
+namespace milg::graphics {
+    std::unique_ptr<UploadQueue> UploadQueue::create(const VulkanContext &context, VkDeviceSize staging_size) {
+        auto      &device_table = context.device_table();
+        auto       upload_queue = std::unique_ptr<UploadQueue>(new UploadQueue(context));
+        const bool dedicated    = context.transfer_queue_family_index() != context.graphics_queue_family_index();
+        const auto alignment    = std::max<VkDeviceSize>(context.device_limits().optimalBufferCopyOffsetAlignment, 16);
+
+        MILG_INFO("Creating upload queue with {} MiB of staging memory{}", staging_size / (1024 * 1024),
+                  dedicated ? " on a dedicated transfer queue" : "");
+
+        VkCommandPoolCreateInfo command_pool_info = {
+            .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext            = nullptr,
+            .flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = context.transfer_queue_family_index(),
+        };
+        VK_CHECK(device_table.vkCreateCommandPool(context.device(), &command_pool_info, nullptr,
+                                                  &upload_queue->m_transfer_command_pool));
+
+        if (dedicated) {
+            command_pool_info.queueFamilyIndex = context.graphics_queue_family_index();
+            VK_CHECK(device_table.vkCreateCommandPool(context.device(), &command_pool_info, nullptr,
+                                                      &upload_queue->m_graphics_command_pool));
+        }
+
+        const VkSemaphoreTypeCreateInfo semaphore_type_info = {
+            .sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .pNext         = nullptr,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue  = 0,
+        };
+
+        const VkSemaphoreCreateInfo semaphore_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &semaphore_type_info,
+            .flags = 0,
+        };
+        VK_CHECK(device_table.vkCreateSemaphore(context.device(), &semaphore_info, nullptr,
+                                                &upload_queue->m_timeline_semaphore));
+
+        void         *ring_data       = nullptr;
+        VmaAllocation ring_allocation = VK_NULL_HANDLE;
+        VkBuffer      ring_buffer     = create_staging_buffer(context, staging_size, &ring_allocation, &ring_data);
+
+        upload_queue->m_dedicated_transfer = dedicated;
+        upload_queue->m_ring_buffer        = ring_buffer;
+        upload_queue->m_ring_allocation    = ring_allocation;
+        upload_queue->m_ring_data          = static_cast<std::byte *>(ring_data);
+        upload_queue->m_ring_size          = staging_size;
+        upload_queue->m_ring_alignment     = alignment;
+
+        return upload_queue;
+    }
+
+    UploadQueue::UploadQueue(const VulkanContext &context) : m_context(context) {
+    }
+
+    UploadQueue::~UploadQueue() {
+        wait(flush());
+        reclaim();
+
+        auto &device_table = m_context.device_table();
+
+        vmaDestroyBuffer(m_context.allocator(), m_ring_buffer, m_ring_allocation);
+        device_table.vkDestroySemaphore(m_context.device(), m_timeline_semaphore, nullptr);
+        device_table.vkDestroyCommandPool(m_context.device(), m_transfer_command_pool, nullptr);
+        if (m_graphics_command_pool != VK_NULL_HANDLE) {
+            device_table.vkDestroyCommandPool(m_context.device(), m_graphics_command_pool, nullptr);
+        }
+    }
+
+    uint64_t UploadQueue::upload_image(VkImage image, VkExtent3D extent, const void *data, VkDeviceSize size) {
+        const VkDeviceSize level_offset = 0;
+
+        return upload_image(image, extent, 1, {&level_offset, 1}, data, size);
+    }
+
+    uint64_t UploadQueue::upload_image(VkImage image, VkExtent3D extent, uint32_t mip_levels,
+                                       std::span<const VkDeviceSize> level_offsets, const void *data,
+                                       VkDeviceSize size) {
+        auto staging = allocate(data, size);
+        begin_recording();
+
+        auto          &device_table    = m_context.device_table();
+        const uint32_t provided_levels = static_cast<uint32_t>(level_offsets.size());
+        const bool     generate_mips   = provided_levels < mip_levels;
+
+        // Blits need a graphics queue, without a dedicated transfer queue the upload already runs on one
+        VkCommandBuffer graphics_command_buffer =
+            m_dedicated_transfer ? m_recording.graphics_command_buffer : m_recording.transfer_command_buffer;
+
+        VkImageMemoryBarrier2 barrier = {
+            .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .pNext               = nullptr,
+            .srcStageMask        = VK_PIPELINE_STAGE_2_NONE,
+            .srcAccessMask       = VK_ACCESS_2_NONE,
+            .dstStageMask        = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .dstAccessMask       = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image               = image,
+            .subresourceRange =
+                {
+                    .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel   = 0,
+                    .levelCount     = mip_levels,
+                    .baseArrayLayer = 0,
+                    .layerCount     = 1,
+                },
+        };
+        pipeline_barrier(device_table, m_recording.transfer_command_buffer, &barrier, nullptr);
+
+        std::vector<VkBufferImageCopy> copy_regions;
+        for (uint32_t level = 0; level < provided_levels; level++) {
+            copy_regions.push_back({
+                .bufferOffset      = staging.offset + level_offsets[level],
+                .bufferRowLength   = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource =
+                    {
+                        .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel       = level,
+                        .baseArrayLayer = 0,
+                        .layerCount     = 1,
+                    },
+                .imageOffset = {0, 0, 0},
+                .imageExtent =
+                    {
+                        .width  = std::max(extent.width >> level, 1u),
+                        .height = std::max(extent.height >> level, 1u),
+                        .depth  = 1,
+                    },
+            });
+        }
+        device_table.vkCmdCopyBufferToImage(m_recording.transfer_command_buffer, staging.buffer, image,
+                                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                            static_cast<uint32_t>(copy_regions.size()), copy_regions.data());
+
+        // With a dedicated transfer queue this is the release half of the ownership transfer, the graphics queue
+        // performs the matching acquire (and the identical layout transition) before the batch is signalled.
+        // Images that still need their mips generated stay in TRANSFER_DST for the blits
+        const VkImageLayout handoff_layout =
+            generate_mips ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        if (m_dedicated_transfer || !generate_mips) {
+            barrier.srcStageMask  = VK_PIPELINE_STAGE_2_COPY_BIT;
+            barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            barrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
+            barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout     = handoff_layout;
+            if (m_dedicated_transfer) {
+                barrier.dstStageMask        = VK_PIPELINE_STAGE_2_NONE;
+                barrier.dstAccessMask       = VK_ACCESS_2_NONE;
+                barrier.srcQueueFamilyIndex = m_context.transfer_queue_family_index();
+                barrier.dstQueueFamilyIndex = m_context.graphics_queue_family_index();
+            }
+            pipeline_barrier(device_table, m_recording.transfer_command_buffer, &barrier, nullptr);
+
+            if (m_dedicated_transfer) {
+                barrier.srcStageMask  = VK_PIPELINE_STAGE_2_NONE;
+                barrier.srcAccessMask = VK_ACCESS_2_NONE;
+                barrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+                barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
+                if (generate_mips) {
+                    barrier.dstStageMask  = VK_PIPELINE_STAGE_2_BLIT_BIT;
+                    barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+                }
+                pipeline_barrier(device_table, graphics_command_buffer, &barrier, nullptr);
+            }
+        }
+
+        if (!generate_mips) {
+            return pending_value();
+        }
+
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+        for (uint32_t level = provided_levels; level < mip_levels; level++) {
+            barrier.srcStageMask                  = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT;
+            barrier.srcAccessMask                 = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            barrier.dstStageMask                  = VK_PIPELINE_STAGE_2_BLIT_BIT;
+            barrier.dstAccessMask                 = VK_ACCESS_2_TRANSFER_READ_BIT;
+            barrier.oldLayout                     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout                     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.subresourceRange.baseMipLevel = level - 1;
+            barrier.subresourceRange.levelCount   = 1;
+            pipeline_barrier(device_table, graphics_command_buffer, &barrier, nullptr);
+
+            const VkImageBlit2 blit_region = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
+                .pNext = nullptr,
+                .srcSubresource =
+                    {
+                        .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel       = level - 1,
+                        .baseArrayLayer = 0,
+                        .layerCount     = 1,
+                    },
+                .srcOffsets =
+                    {
+                        {0, 0, 0},
+                        {
+                            static_cast<int32_t>(std::max(extent.width >> (level - 1), 1u)),
+                            static_cast<int32_t>(std::max(extent.height >> (level - 1), 1u)),
+                            1,
+                        },
+                    },
+                .dstSubresource =
+                    {
+                        .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel       = level,
+                        .baseArrayLayer = 0,
+                        .layerCount     = 1,
+                    },
+                .dstOffsets =
+                    {
+                        {0, 0, 0},
+                        {
+                            static_cast<int32_t>(std::max(extent.width >> level, 1u)),
+                            static_cast<int32_t>(std::max(extent.height >> level, 1u)),
+                            1,
+                        },
+                    },
+            };
+
+            const VkBlitImageInfo2 blit_info = {
+                .sType          = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2,
+                .pNext          = nullptr,
+                .srcImage       = image,
+                .srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                .dstImage       = image,
+                .dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .regionCount    = 1,
+                .pRegions       = &blit_region,
+                .filter         = VK_FILTER_LINEAR,
+            };
+            device_table.vkCmdBlitImage2(graphics_command_buffer, &blit_info);
+        }
+
+        // The blit sources are in TRANSFER_SRC, the last generated level and the provided levels before the first
+        // source are still in TRANSFER_DST
+        barrier.srcStageMask                  = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT;
+        barrier.srcAccessMask                 = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier.dstStageMask                  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        barrier.dstAccessMask                 = VK_ACCESS_2_SHADER_READ_BIT;
+        barrier.oldLayout                     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout                     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.subresourceRange.baseMipLevel = provided_levels - 1;
+        barrier.subresourceRange.levelCount   = mip_levels - provided_levels;
+        pipeline_barrier(device_table, graphics_command_buffer, &barrier, nullptr);
+
+        barrier.oldLayout                     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+        barrier.subresourceRange.levelCount   = 1;
+        pipeline_barrier(device_table, graphics_command_buffer, &barrier, nullptr);
+
+        if (provided_levels > 1) {
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount   = provided_levels - 1;
+            pipeline_barrier(device_table, graphics_command_buffer, &barrier, nullptr);
+        }
+
+        return pending_value();
+    }
+
+    uint64_t UploadQueue::upload_buffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size) {
+        auto staging = allocate(data, size);
+        begin_recording();
+
+        auto &device_table = m_context.device_table();
+
+        const VkBufferCopy copy_region = {
+            .srcOffset = staging.offset,
+            .dstOffset = offset,
+            .size      = size,
+        };
+        device_table.vkCmdCopyBuffer(m_recording.transfer_command_buffer, staging.buffer, buffer, 1, &copy_region);
+
+        VkBufferMemoryBarrier2 barrier = {
+            .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+            .pNext               = nullptr,
+            .srcStageMask        = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .srcAccessMask       = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask        = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .dstAccessMask       = VK_ACCESS_2_MEMORY_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer              = buffer,
+            .offset              = offset,
+            .size                = size,
+        };
+
+        if (!m_dedicated_transfer) {
+            pipeline_barrier(device_table, m_recording.transfer_command_buffer, nullptr, &barrier);
+
+            return pending_value();
+        }
+
+        barrier.dstStageMask        = VK_PIPELINE_STAGE_2_NONE;
+        barrier.dstAccessMask       = VK_ACCESS_2_NONE;
+        barrier.srcQueueFamilyIndex = m_context.transfer_queue_family_index();
+        barrier.dstQueueFamilyIndex = m_context.graphics_queue_family_index();
+        pipeline_barrier(device_table, m_recording.transfer_command_buffer, nullptr, &barrier);
+
+        barrier.srcStageMask  = VK_PIPELINE_STAGE_2_NONE;
+        barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        barrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+        pipeline_barrier(device_table, m_recording.graphics_command_buffer, nullptr, &barrier);
+
+        return pending_value();
+    }
+
+    uint64_t UploadQueue::flush() {
+        reclaim();
+
+        if (m_recording.transfer_command_buffer == VK_NULL_HANDLE) {
+            return m_timeline_value;
+        }
+
+        auto &device_table = m_context.device_table();
+
+        VK_CHECK(device_table.vkEndCommandBuffer(m_recording.transfer_command_buffer));
+        if (m_dedicated_transfer) {
+            VK_CHECK(device_table.vkEndCommandBuffer(m_recording.graphics_command_buffer));
+        }
+
+        const VkCommandBufferSubmitInfo transfer_command_buffer_info = {
+            .sType         = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+            .pNext         = nullptr,
+            .commandBuffer = m_recording.transfer_command_buffer,
+            .deviceMask    = 0,
+        };
+
+        const VkSemaphoreSubmitInfo transfer_signal_info = {
+            .sType       = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .pNext       = nullptr,
+            .semaphore   = m_timeline_semaphore,
+            .value       = ++m_timeline_value,
+            .stageMask   = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .deviceIndex = 0,
+        };
+
+        const VkSubmitInfo2 transfer_submit_info = {
+            .sType                    = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .pNext                    = nullptr,
+            .flags                    = 0,
+            .waitSemaphoreInfoCount   = 0,
+            .pWaitSemaphoreInfos      = nullptr,
+            .commandBufferInfoCount   = 1,
+            .pCommandBufferInfos      = &transfer_command_buffer_info,
+            .signalSemaphoreInfoCount = 1,
+            .pSignalSemaphoreInfos    = &transfer_signal_info,
+        };
+        VK_CHECK(device_table.vkQueueSubmit2(m_context.transfer_queue(), 1, &transfer_submit_info, VK_NULL_HANDLE));
+
+        if (m_dedicated_transfer) {
+            const VkCommandBufferSubmitInfo graphics_command_buffer_info = {
+                .sType         = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+                .pNext         = nullptr,
+                .commandBuffer = m_recording.graphics_command_buffer,
+                .deviceMask    = 0,
+            };
+
+            const VkSemaphoreSubmitInfo graphics_signal_info = {
+                .sType       = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                .pNext       = nullptr,
+                .semaphore   = m_timeline_semaphore,
+                .value       = ++m_timeline_value,
+                .stageMask   = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .deviceIndex = 0,
+            };
+
+            const VkSubmitInfo2 graphics_submit_info = {
+                .sType                    = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+                .pNext                    = nullptr,
+                .flags                    = 0,
+                .waitSemaphoreInfoCount   = 1,
+                .pWaitSemaphoreInfos      = &transfer_signal_info,
+                .commandBufferInfoCount   = 1,
+                .pCommandBufferInfos      = &graphics_command_buffer_info,
+                .signalSemaphoreInfoCount = 1,
+                .pSignalSemaphoreInfos    = &graphics_signal_info,
+            };
+            VK_CHECK(
+                device_table.vkQueueSubmit2(m_context.graphics_queue(), 1, &graphics_submit_info, VK_NULL_HANDLE));
+        }
+
+        m_recording.value    = m_timeline_value;
+        m_recording.ring_end = m_ring_head;
+        m_in_flight.push_back(std::move(m_recording));
+        m_recording = {};
+
+        return m_timeline_value;
+    }
+
+    bool UploadQueue::is_complete(uint64_t value) const {
+        uint64_t current_value = 0;
+        VK_CHECK(m_context.device_table().vkGetSemaphoreCounterValue(m_context.device(), m_timeline_semaphore,
+                                                                     &current_value));
+
+        return current_value >= value;
+    }
+
+    void UploadQueue::wait(uint64_t value) {
+        if (value > m_timeline_value) {
+            flush();
+        }
+
+        const VkSemaphoreWaitInfo wait_info = {
+            .sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .pNext          = nullptr,
+            .flags          = 0,
+            .semaphoreCount = 1,
+            .pSemaphores    = &m_timeline_semaphore,
+            .pValues        = &value,
+        };
+        VK_CHECK(m_context.device_table().vkWaitSemaphores(m_context.device(), &wait_info, UINT64_MAX));
+    }
+
+    VkSemaphore UploadQueue::timeline_semaphore() const {
+        return m_timeline_semaphore;
+    }
+
+    bool UploadQueue::has_dedicated_transfer_queue() const {
+        return m_dedicated_transfer;
+    }
+
+    UploadQueue::Allocation UploadQueue::allocate(const void *data, VkDeviceSize size) {
+        // Large uploads would stall the ring, they get a staging buffer of their own that lives as long as the batch
+        if (size > m_ring_size / 4) {
+            StagingBuffer staging = {};
+            void         *mapped  = nullptr;
+
+            staging.buffer = create_staging_buffer(m_context, size, &staging.allocation, &mapped);
+            memcpy(mapped, data, size);
+            VK_CHECK(vmaFlushAllocation(m_context.allocator(), staging.allocation, 0, size));
+            m_recording.dedicated_staging.push_back(staging);
+
+            return {
+                .buffer = staging.buffer,
+                .offset = 0,
+            };
+        }
+
+        uint64_t head = (m_ring_head + m_ring_alignment - 1) / m_ring_alignment * m_ring_alignment;
+        if (head % m_ring_size + size > m_ring_size) {
+            head += m_ring_size - head % m_ring_size;
+        }
+
+        while (head + size - m_ring_tail > m_ring_size) {
+            if (m_in_flight.empty()) {
+                flush();
+            }
+            if (m_in_flight.empty()) {
+                break;
+            }
+
+            wait(m_in_flight.front().value);
+            reclaim();
+        }
+
+        const VkDeviceSize offset = head % m_ring_size;
+        memcpy(m_ring_data + offset, data, size);
+        // A no-op on host coherent memory, which VMA isn't required to pick for the staging buffers
+        VK_CHECK(vmaFlushAllocation(m_context.allocator(), m_ring_allocation, offset, size));
+        m_ring_head = head + size;
+
+        return {
+            .buffer = m_ring_buffer,
+            .offset = offset,
+        };
+    }
+
+    void UploadQueue::begin_recording() {
+        if (m_recording.transfer_command_buffer != VK_NULL_HANDLE) {
+            return;
+        }
+
+        auto &device_table = m_context.device_table();
+
+        VkCommandBufferAllocateInfo allocate_info = {
+            .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .pNext              = nullptr,
+            .commandPool        = m_transfer_command_pool,
+            .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+
+        const VkCommandBufferBeginInfo begin_info = {
+            .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext            = nullptr,
+            .flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = nullptr,
+        };
+
+        VK_CHECK(device_table.vkAllocateCommandBuffers(m_context.device(), &allocate_info,
+                                                       &m_recording.transfer_command_buffer));
+        VK_CHECK(device_table.vkBeginCommandBuffer(m_recording.transfer_command_buffer, &begin_info));
+
+        if (m_dedicated_transfer) {
+            allocate_info.commandPool = m_graphics_command_pool;
+
+            VK_CHECK(device_table.vkAllocateCommandBuffers(m_context.device(), &allocate_info,
+                                                           &m_recording.graphics_command_buffer));
+            VK_CHECK(device_table.vkBeginCommandBuffer(m_recording.graphics_command_buffer, &begin_info));
+        }
+    }
+
+    void UploadQueue::reclaim() {
+        auto &device_table = m_context.device_table();
+
+        while (!m_in_flight.empty() && is_complete(m_in_flight.front().value)) {
+            auto &batch = m_in_flight.front();
+
+            device_table.vkFreeCommandBuffers(m_context.device(), m_transfer_command_pool, 1,
+                                              &batch.transfer_command_buffer);
+            if (batch.graphics_command_buffer != VK_NULL_HANDLE) {
+                device_table.vkFreeCommandBuffers(m_context.device(), m_graphics_command_pool, 1,
+                                                  &batch.graphics_command_buffer);
+            }
+            for (auto &staging : batch.dedicated_staging) {
+                vmaDestroyBuffer(m_context.allocator(), staging.buffer, staging.allocation);
+            }
+
+            m_ring_tail = batch.ring_end;
+            m_in_flight.pop_front();
+        }
+    }
+
+    uint64_t UploadQueue::pending_value() const {
+        return m_timeline_value + (m_dedicated_transfer ? 2 : 1);
+    }
+} // namespace milg::graphics
@@ -2,8 +2,18 @@
 
 #include <milg/core/logging.hpp>
 #include <milg/core/window.hpp>
+#include <milg/graphics/barrier_batch.hpp>
+#include <milg/graphics/descriptor_heap.hpp>
+#include <milg/graphics/pipeline_cache.hpp>
+#include <milg/graphics/upload_queue.hpp>
 
+#include <SDL_filesystem.h>
+#include <SDL_stdinc.h>
+
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
@@ -16,8 +26,11 @@
 const std::vector<const char *> requested_instance_layers = {"VK_LAYER_KHRONOS_validation"};
 const std::vector<const char *> requested_device_layers   = {"VK_LAYER_KHRONOS_validation"};
 
+const VkDeviceSize upload_staging_size = 64 * 1024 * 1024;
+
 namespace milg::graphics {
-    std::shared_ptr<VulkanContext> VulkanContext::create(const std::unique_ptr<Window> &window) {
+    std::shared_ptr<VulkanContext> VulkanContext::create(const std::unique_ptr<Window> &window,
+                                                         uint32_t                       frames_in_flight) {
         MILG_INFO("Creating Vulkan context");
         VK_CHECK(volkInitialize());
 
@@ -123,6 +136,45 @@ namespace milg::graphics {
             VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         };
 
+        uint32_t extension_count = 0u;
+        VK_CHECK(vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr));
+
+        std::vector<VkExtensionProperties> extensions(extension_count);
+        VK_CHECK(vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, extensions.data()));
+
+        auto has_extension = [&extensions](const char *name) {
+            return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties &extension) {
+                return strcmp(extension.extensionName, name) == 0;
+            });
+        };
+
+        // Present wait is optional, it only lets the application pace frames on when they reach the screen
+        VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {
+            .sType     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+            .pNext     = nullptr,
+            .presentId = VK_FALSE,
+        };
+        VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {
+            .sType       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+            .pNext       = &present_id_features,
+            .presentWait = VK_FALSE,
+        };
+        if (has_extension(VK_KHR_PRESENT_ID_EXTENSION_NAME) && has_extension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+            VkPhysicalDeviceFeatures2 extension_features = {
+                .sType    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext    = &present_wait_features,
+                .features = {},
+            };
+            vkGetPhysicalDeviceFeatures2(physical_device, &extension_features);
+        }
+
+        const bool present_wait =
+            present_id_features.presentId == VK_TRUE && present_wait_features.presentWait == VK_TRUE;
+        if (present_wait) {
+            requested_device_extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            requested_device_extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        }
+
         uint32_t queue_family_count = 0u;
         vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
 
@@ -137,30 +189,69 @@ namespace milg::graphics {
             }
         }
 
-        float                         queue_priority = 1.0f;
-        const VkDeviceQueueCreateInfo queue_info     = {
+        // Prefer a transfer-only family (the copy engine on discrete GPUs), then any non-graphics one
+        uint32_t transfer_queue_family_index = queue_family_index;
+        for (uint32_t i = 0; i < queue_family_count; ++i) {
+            const auto flags = queue_families[i].queueFlags;
+            if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+                continue;
+            }
+
+            if (!(flags & VK_QUEUE_COMPUTE_BIT)) {
+                transfer_queue_family_index = i;
+                break;
+            }
+
+            if (transfer_queue_family_index == queue_family_index) {
+                transfer_queue_family_index = i;
+            }
+        }
+
+        float                                queue_priority = 1.0f;
+        std::vector<VkDeviceQueueCreateInfo> queue_infos;
+
+        queue_infos.push_back({
+            .sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .pNext            = nullptr,
+            .flags            = 0,
+            .queueFamilyIndex = queue_family_index,
+            .queueCount       = 1,
+            .pQueuePriorities = &queue_priority,
+        });
+
+        if (transfer_queue_family_index != queue_family_index) {
+            queue_infos.push_back({
                 .sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
                 .pNext            = nullptr,
                 .flags            = 0,
-                .queueFamilyIndex = queue_family_index,
+                .queueFamilyIndex = transfer_queue_family_index,
                 .queueCount       = 1,
                 .pQueuePriorities = &queue_priority,
-        };
+            });
+        }
+
+        VkPhysicalDeviceFeatures supported_features = {};
+        vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
 
+        // Block compressed formats are optional, precompiled textures fall back to their source images without them
         VkPhysicalDeviceFeatures features = {};
+        features.textureCompressionBC     = supported_features.textureCompressionBC;
 
         VkPhysicalDeviceVulkan12Features vulkan_12_features{
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
-            .pNext = nullptr,
+            .pNext = present_wait ? &present_wait_features : nullptr,
         };
-        vulkan_12_features.bufferDeviceAddress                          = VK_TRUE;
-        vulkan_12_features.descriptorIndexing                           = VK_TRUE;
-        vulkan_12_features.runtimeDescriptorArray                       = VK_TRUE;
-        vulkan_12_features.descriptorBindingPartiallyBound              = VK_TRUE;
-        vulkan_12_features.descriptorBindingVariableDescriptorCount     = VK_TRUE;
-        vulkan_12_features.shaderSampledImageArrayNonUniformIndexing    = VK_TRUE;
-        vulkan_12_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
-        vulkan_12_features.hostQueryReset                               = VK_TRUE;
+        vulkan_12_features.bufferDeviceAddress                           = VK_TRUE;
+        vulkan_12_features.descriptorIndexing                            = VK_TRUE;
+        vulkan_12_features.runtimeDescriptorArray                        = VK_TRUE;
+        vulkan_12_features.descriptorBindingPartiallyBound               = VK_TRUE;
+        vulkan_12_features.descriptorBindingVariableDescriptorCount      = VK_TRUE;
+        vulkan_12_features.shaderSampledImageArrayNonUniformIndexing     = VK_TRUE;
+        vulkan_12_features.descriptorBindingSampledImageUpdateAfterBind  = VK_TRUE;
+        vulkan_12_features.descriptorBindingStorageImageUpdateAfterBind  = VK_TRUE;
+        vulkan_12_features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        vulkan_12_features.hostQueryReset                                = VK_TRUE;
+        vulkan_12_features.timelineSemaphore                             = VK_TRUE;
 
         VkPhysicalDeviceVulkan13Features vulkan_13_features = {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
@@ -173,8 +264,8 @@ namespace milg::graphics {
             .sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
             .pNext                   = &vulkan_13_features,
             .flags                   = 0,
-            .queueCreateInfoCount    = 1,
-            .pQueueCreateInfos       = &queue_info,
+            .queueCreateInfoCount    = static_cast<uint32_t>(queue_infos.size()),
+            .pQueueCreateInfos       = queue_infos.data(),
             .enabledLayerCount       = static_cast<uint32_t>(requested_device_layers.size()),
             .ppEnabledLayerNames     = requested_device_layers.data(),
             .enabledExtensionCount   = static_cast<uint32_t>(requested_device_extensions.size()),
@@ -192,6 +283,9 @@ namespace milg::graphics {
         VkQueue graphics_queue;
         device_table.vkGetDeviceQueue(device, queue_family_index, 0, &graphics_queue);
 
+        VkQueue transfer_queue;
+        device_table.vkGetDeviceQueue(device, transfer_queue_family_index, 0, &transfer_queue);
+
         VkPhysicalDeviceMemoryProperties memory_properties;
         vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
 
@@ -260,14 +354,33 @@ namespace milg::graphics {
         context->m_graphics_queue_family_index = queue_family_index;
         context->m_debug_messenger             = debug_messenger;
         context->m_graphics_queue              = graphics_queue;
+        context->m_transfer_queue_family_index = transfer_queue_family_index;
+        context->m_transfer_queue              = transfer_queue;
+        context->m_bc_compression              = features.textureCompressionBC == VK_TRUE;
+        context->m_present_wait                = present_wait;
         context->m_memory_properties           = memory_properties;
         context->m_allocator                   = allocator;
+        context->m_frames_in_flight            = std::clamp(frames_in_flight, 2u, 3u);
         context->m_command_pool                = command_pool;
+        context->m_upload_queue                = UploadQueue::create(*context, upload_staging_size);
+
+        // The per user data directory survives reinstalls and isn't shared between users, fall back to the working
+        // directory when SDL can't provide one
+        std::filesystem::path cache_directory = ".";
+        if (char *pref_path = SDL_GetPrefPath("Gainz-Interactive", "milg"); pref_path != nullptr) {
+            cache_directory = pref_path;
+            SDL_free(pref_path);
+        }
+        context->m_pipeline_cache  = PipelineCache::create(*context, cache_directory);
+        context->m_descriptor_heap = DescriptorHeap::create(*context, {});
 
         return context;
     }
 
     VulkanContext::~VulkanContext() {
+        m_descriptor_heap.reset();
+        m_pipeline_cache.reset();
+        m_upload_queue.reset();
         vmaDestroyAllocator(m_allocator);
         m_device_table.vkDestroyCommandPool(m_device, m_command_pool, nullptr);
         m_device_table.vkDestroyDevice(m_device, nullptr);
@@ -311,10 +424,51 @@ namespace milg::graphics {
         return m_graphics_queue;
     }
 
+    uint32_t VulkanContext::transfer_queue_family_index() const {
+        return m_transfer_queue_family_index;
+    }
+
+    VkQueue VulkanContext::transfer_queue() const {
+        return m_transfer_queue;
+    }
+
+    bool VulkanContext::supports_bc_compression() const {
+        return m_bc_compression;
+    }
+
+    bool VulkanContext::supports_present_wait() const {
+        return m_present_wait;
+    }
+
     VmaAllocator VulkanContext::allocator() const {
         return m_allocator;
     }
 
+    UploadQueue &VulkanContext::upload_queue() const {
+        return *m_upload_queue;
+    }
+
+    VkPipelineCache VulkanContext::pipeline_cache() const {
+        return m_pipeline_cache->handle();
+    }
+
+    DescriptorHeap &VulkanContext::descriptor_heap() const {
+        return *m_descriptor_heap;
+    }
+
+    uint32_t VulkanContext::frames_in_flight() const {
+        return m_frames_in_flight;
+    }
+
+    uint32_t VulkanContext::frame_index() const {
+        return m_frame_index;
+    }
+
+    void VulkanContext::set_frame_index(uint32_t frame_index) {
+        m_frame_index = frame_index;
+        m_descriptor_heap->release_retired(frame_index);
+    }
+
     uint32_t VulkanContext::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const {
         for (uint32_t i = 0; i < m_memory_properties.memoryTypeCount; i++) {
             if ((type_filter & (1 << i)) &&
@@ -327,40 +481,10 @@ namespace milg::graphics {
     }
 
     void VulkanContext::transition_image_layout(VkCommandBuffer command_buffer, VkImage image, VkImageLayout old_layout,
-                                                VkImageLayout new_layout) const {
-        VkImageMemoryBarrier2 image_barrier = {
-            .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-            .pNext               = nullptr,
-            .srcStageMask        = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-            .srcAccessMask       = VK_ACCESS_2_MEMORY_WRITE_BIT,
-            .dstStageMask        = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-            .dstAccessMask       = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
-            .oldLayout           = old_layout,
-            .newLayout           = new_layout,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image               = image,
-            .subresourceRange    = {.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-                                    .baseMipLevel   = 0,
-                                    .levelCount     = 1,
-                                    .baseArrayLayer = 0,
-                                    .layerCount     = 1},
-
-        };
-
-        VkDependencyInfo dependency_info = {
-            .sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-            .pNext                    = nullptr,
-            .dependencyFlags          = VK_DEPENDENCY_BY_REGION_BIT,
-            .memoryBarrierCount       = 0,
-            .pMemoryBarriers          = nullptr,
-            .bufferMemoryBarrierCount = 0,
-            .pBufferMemoryBarriers    = nullptr,
-            .imageMemoryBarrierCount  = 1,
-            .pImageMemoryBarriers     = &image_barrier,
-        };
-
-        vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+                                                VkImageLayout new_layout, uint32_t mip_levels) const {
+        BarrierBatch batch;
+        batch.transition(image, old_layout, new_layout, mip_levels);
+        batch.flush(*this, command_buffer);
     }
 
     VkCommandBuffer VulkanContext::begin_single_time_commands() const {
@@ -390,6 +514,9 @@ namespace milg::graphics {
     void VulkanContext::end_single_time_commands(VkCommandBuffer command_buffer) const {
         VK_CHECK(m_device_table.vkEndCommandBuffer(command_buffer));
 
+        // Pending uploads have to reach the graphics queue first, the commands may use the uploaded resources
+        m_upload_queue->flush();
+
         VkSubmitInfo submit_info = {
             .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
             .pNext                = nullptr,
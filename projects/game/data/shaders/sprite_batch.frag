@@ -7,7 +7,7 @@ layout(location = 0) in vec2 frag_uv;
 layout(location = 1) in vec4 frag_color;
 layout(location = 2) flat in uint texture_id;
 
-layout(binding = 1) uniform sampler2D textures[];
+layout(set = 0, binding = 0) uniform sampler2D textures[];
 
 layout(location = 0) out vec4 out_color;
 layout(location = 1) out vec4 out_emissive;
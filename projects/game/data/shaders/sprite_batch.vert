@@ -1,10 +1,12 @@
 
 #version 450
 
-layout(location = 0) in vec4 in_position_size;
-layout(location = 1) in vec4 in_uv;
-layout(location = 2) in vec4 in_color;
-layout(location = 3) in vec2 in_rotation_texture_index;
+// Matches SpriteInstance, the formats of the vertex attributes do the unpacking
+layout(location = 0) in vec2 in_position;
+layout(location = 1) in vec2 in_size;
+layout(location = 2) in vec4 in_uv;
+layout(location = 3) in vec4 in_color;
+layout(location = 4) in uvec2 in_rotation_texture_index;
 
 layout(location = 0) out vec2 frag_uv;
 layout(location = 1) out vec4 frag_color;
@@ -30,10 +32,10 @@ void main() {
     const uint corner_index = vertex_idx > 2 ? (vertex_idx - 1) % 4 : vertex_idx;
 
     vec2 pos = positions[corner_index];
-    pos *= in_position_size.zw;
-    pos = rotate(pos, in_rotation_texture_index.x);
+    pos *= in_size;
+    pos = rotate(pos, float(in_rotation_texture_index.x) * (6.28318530718 / 65536.0));
 
-    pos += in_position_size.xy;
+    pos += in_position;
 
     gl_Position = push_constants.view_proj * vec4(pos, 0.0, 1.0);
 
@@ -41,5 +43,5 @@ void main() {
 
     frag_uv = uvs[corner_index];
     frag_color = in_color;
-    out_texture_id = uint(in_rotation_texture_index.y);
+    out_texture_id = in_rotation_texture_index.y;
 }
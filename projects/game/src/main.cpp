@@ -12,6 +12,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include <cstdint>
+#include <vector>
 
 using namespace milg;
 using namespace milg::graphics;
@@ -31,12 +32,16 @@ public:
         auto &window = Application::get().window();
 
         TextureCreateInfo texture_info = {
-            .format     = VK_FORMAT_R8G8B8A8_UNORM,
-            .usage      = VK_IMAGE_USAGE_SAMPLED_BIT,
-            .min_filter = VK_FILTER_NEAREST,
-            .mag_filter = VK_FILTER_NEAREST,
+            .format        = VK_FORMAT_R8G8B8A8_UNORM,
+            .usage         = VK_IMAGE_USAGE_SAMPLED_BIT,
+            .min_filter    = VK_FILTER_LINEAR,
+            .mag_filter    = VK_FILTER_NEAREST,
+            .generate_mips = true,
         };
 
+        // Tilesets are minified when zoomed out, load them with a mip chain so sampling reads from the smaller levels
+        AssetStore::register_loader<Texture>(std::make_shared<Texture::Loader>(context, texture_info));
+
         this->map = *AssetStore::load<Map>("maps/desert.tmj");
 
         this->framebuffer =
@@ -47,7 +52,7 @@ public:
 
         // Capacity here is the maximum amount of sprites that can be drawn in one frame, more number
         // allocates more memory, but it's not that much to begin with
-        this->sprite_batch = SpriteBatch::create(context, framebuffer->format(), 10000);
+        this->sprite_batch = SpriteBatch::create(context, framebuffer->format());
     }
 
     void on_update(float delta) override {
@@ -78,15 +83,31 @@ public:
         sprite_batch->reset();
         sprite_batch->begin_batch(mat);
 
-        auto       tile_size = this->map->get_tile_size();
-        glm::ivec2 cursor;
+        // Visible tiles are looked up on the job workers a few rows at a time, drawing stays on this thread and in row
+        // order so the batch contents don't depend on which worker finished first
+        auto           tile_size = this->map->get_tile_size();
+        const uint32_t row_count = (framebuffer->height() + tile_size.y - 1) / tile_size.y;
+
+        std::vector<std::vector<std::shared_ptr<Tile>>> rows(row_count);
+        Application::get().scheduler().parallel_for(0, row_count, 4, [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; ++row) {
+                glm::ivec2 cursor = {0, static_cast<int32_t>(row) * tile_size.y};
 
-        for (cursor.y = 0; cursor.y < framebuffer->height(); cursor.y += tile_size.y) {
-            for (cursor.x = 0; cursor.x < framebuffer->width(); cursor.x += tile_size.x) {
-                for (auto &tile : this->map->get_tiles(cursor)) {
-                    sprite_batch->draw_sprite(tile->sprite, tile->tileset->get_texture());
+                for (; cursor.x < framebuffer->width(); cursor.x += tile_size.x) {
+                    auto tiles = this->map->get_tiles(cursor);
+                    rows[row].insert(rows[row].end(), tiles.begin(), tiles.end());
                 }
             }
+        });
+
+        // Tiles carry their tileset's descriptor heap slot, so a whole row goes to the batch in one call
+        std::vector<Sprite> sprites = {};
+        for (auto &row : rows) {
+            sprites.clear();
+            for (auto &tile : row) {
+                sprites.push_back(tile->sprite);
+            }
+            sprite_batch->draw_sprites(sprites);
         }
 
         // After drawing, build_batches should be called, this copies over data to the appropriate buffers
@@ -163,8 +184,15 @@ public:
     Milgame(int argc, char **argv, const WindowCreateInfo &window_info) : Application(argc, argv, window_info) {
         auto bindir = std::filesystem::path(argv[0]).parent_path();
 
+#ifdef NDEBUG
+        AssetStore::add_archive((bindir / "data" / "game.pak").lexically_normal());
+#else
+        // Development builds load loose files so they can be edited while running
+        AssetStore::enable_hot_reload();
+#endif
         AssetStore::add_search_path((bindir / "data").lexically_normal());
         AssetStore::add_search_path(ASSET_DIR);
+        AssetStore::set_memory_budget({.cpu = 256 * 1024 * 1024, .gpu = 512 * 1024 * 1024});
 
         push_layer(new GraphicsLayer());
     }
@@ -176,9 +204,11 @@ public:
 int main(int argc, char **argv) {
     return Milgame(argc, argv,
                    {
-                       .title  = "Milg",
-                       .width  = 1600,
-                       .height = 900,
+                       .title       = "Milg",
+                       .width       = 1600,
+                       .height      = 900,
+                       // Input to photon latency matters more than throughput for the game
+                       .low_latency = true,
                    })
         .run();
 }
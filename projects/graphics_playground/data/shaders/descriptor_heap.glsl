@@ -0,0 +1,11 @@
+// Mirrors milg::graphics::DescriptorHeap and Pipeline. Every array aliases the heap's storage image binding with the
+// format a shader accesses the image with, push constants start with the heap slots of the pipeline's images
+#extension GL_EXT_nonuniform_qualifier : require
+
+#define STORAGE_IMAGE_BINDING 1
+#define MAX_IMAGE_BINDINGS 8
+
+layout(rgba8, set = 0, binding = STORAGE_IMAGE_BINDING) uniform image2D heap_images_rgba8[];
+layout(rg8, set = 0, binding = STORAGE_IMAGE_BINDING) uniform image2D heap_images_rg8[];
+layout(r8, set = 0, binding = STORAGE_IMAGE_BINDING) uniform image2D heap_images_r8[];
+layout(rgba16f, set = 0, binding = STORAGE_IMAGE_BINDING) uniform image2D heap_images_rgba16f[];
@@ -1,6 +1,8 @@
 #include <milg/graphics.hpp>
+#include <milg/graphics/descriptor_heap.hpp>
 #include <milg/graphics/map.hpp>
 #include <milg/graphics/pipeline.hpp>
+#include <milg/graphics/render_graph.hpp>
 #include <milg/graphics/sprite_batch.hpp>
 #include <milg/graphics/texture.hpp>
 #include <milg/milg.hpp>
@@ -52,6 +54,14 @@ public:
     std::shared_ptr<Texture>     light_texture    = nullptr;
     std::shared_ptr<SpriteBatch> sprite_batch     = nullptr;
 
+    // Copied before the sprites are recorded on a worker, so the stats window shows the previous frame
+    struct {
+        uint32_t sprite_count  = 0;
+        uint32_t batch_count   = 0;
+        uint32_t texture_count = 0;
+        uint32_t page_count    = 0;
+    } sprite_batch_stats;
+
     uint64_t                         frame_index             = 0;
     float                            rt_scale                = 0.5f;
     std::shared_ptr<PipelineFactory> pipeline_factory        = nullptr;
@@ -62,9 +72,11 @@ public:
     Pipeline                        *raytrace_pipeline       = nullptr;
     Pipeline                        *rt_upscale_pipeline     = nullptr;
     Pipeline                        *composite_pipeline      = nullptr;
+    std::shared_ptr<RenderGraph>     render_graph            = nullptr;
 
     glm::vec2 mouse_position = {0.0f, 0.0f};
     float     time           = 0.0f;
+    int       present_mode   = static_cast<int>(PresentMode::FIFO);
 
     void on_attach() override {
         MILG_INFO("Initializing Grapchiks");
@@ -97,34 +109,29 @@ public:
             .mag_filter = VK_FILTER_NEAREST,
         };
 
-        this->albedo_texture   = *AssetStore::load<Texture>("textures/map.png");
-        this->emissive_texture = *AssetStore::load<Texture>("textures/map_emissive.png");
-        this->noise_texture    = *AssetStore::load<Texture>("textures/noise.png");
-        this->light_texture    = *AssetStore::load<Texture>("textures/light.png");
+        auto albedo_future   = AssetStore::load_async<Texture>("textures/map.png");
+        auto emissive_future = AssetStore::load_async<Texture>("textures/map_emissive.png");
+        auto noise_future    = AssetStore::load_async<Texture>("textures/noise.png");
+        auto light_future    = AssetStore::load_async<Texture>("textures/light.png");
+
+        this->albedo_texture   = *albedo_future.get();
+        this->emissive_texture = *emissive_future.get();
+        this->noise_texture    = *noise_future.get();
+        this->light_texture    = *light_future.get();
 
-        this->sprite_batch = SpriteBatch::create(context, albedo_buffer->format(), 10000);
+        this->sprite_batch = SpriteBatch::create(context, albedo_buffer->format(),
+                                                 SpriteBatch::DEFAULT_PAGE_CAPACITY, 600);
 
         this->pipeline_factory      = PipelineFactory::create(context);
-        this->voronoi_seed_pipeline = this->pipeline_factory->create_compute_pipeline(
-            "voronoi_seed", "shaders/voronoi_seed.comp.spv",
-            {PipelineOutputDescription{
-                .format = VK_FORMAT_R8G8B8A8_UNORM, .width = window->width(), .height = window->height()}},
-            2);
+        // Targets only used within a frame live in the render graph, which aliases their memory
+        this->voronoi_seed_pipeline =
+            this->pipeline_factory->create_compute_pipeline("voronoi_seed", "shaders/voronoi_seed.comp.spv", {}, 2);
         this->voronoi_pipeline = this->pipeline_factory->create_compute_pipeline(
-            "voronoi", "shaders/voronoi.comp.spv",
-            {PipelineOutputDescription{
-                .format = VK_FORMAT_R8G8B8A8_UNORM, .width = window->width(), .height = window->height()}},
-            2, sizeof(float) * 6);
+            "voronoi", "shaders/voronoi.comp.spv", {}, 2, sizeof(float) * 6);
         this->distance_field_pipeline = this->pipeline_factory->create_compute_pipeline(
-            "distance_field", "shaders/distance_field.comp.spv",
-            {PipelineOutputDescription{
-                .format = VK_FORMAT_R8G8_UNORM, .width = window->width(), .height = window->height()}},
-            2);
+            "distance_field", "shaders/distance_field.comp.spv", {}, 2);
         this->noise_seed_pipeline = this->pipeline_factory->create_compute_pipeline(
-            "noise_seed", "shaders/noise_seed.comp.spv",
-            {PipelineOutputDescription{
-                .format = VK_FORMAT_R8_UNORM, .width = noise_texture->width(), .height = noise_texture->height()}},
-            2, sizeof(float));
+            "noise_seed", "shaders/noise_seed.comp.spv", {}, 2, sizeof(float));
         this->raytrace_pipeline = this->pipeline_factory->create_compute_pipeline(
             "raytrace", "shaders/raytrace.comp.spv",
             {PipelineOutputDescription{.format = VK_FORMAT_R16G16B16A16_SFLOAT,
@@ -135,38 +142,281 @@ public:
                                        .height = static_cast<uint32_t>(window->height() * rt_scale)}},
             6, sizeof(raytrace_pass_constants));
         this->rt_upscale_pipeline = this->pipeline_factory->create_compute_pipeline(
-            "rt_upscale", "shaders/rt_upscale.comp.spv",
-            {PipelineOutputDescription{.format = VK_FORMAT_R16G16B16A16_SFLOAT,
-                                       .width  = static_cast<uint32_t>(window->width() * rt_scale),
-                                       .height = static_cast<uint32_t>(window->height() * rt_scale)},
-             PipelineOutputDescription{
-                 .format = VK_FORMAT_R16G16B16A16_SFLOAT, .width = window->width(), .height = window->height()}},
-            2, sizeof(rt_upscale_pass_constants));
+            "rt_upscale", "shaders/rt_upscale.comp.spv", {}, 2, sizeof(rt_upscale_pass_constants));
         this->composite_pipeline = this->pipeline_factory->create_compute_pipeline(
-            "composite", "shaders/composite.comp.spv",
-            {PipelineOutputDescription{
-                .format = VK_FORMAT_R8G8B8A8_UNORM, .width = window->width(), .height = window->height()}},
-            4, sizeof(composite_pass_constants));
-    }
+            "composite", "shaders/composite.comp.spv", {}, 4, sizeof(composite_pass_constants));
+
+        // The radiance buffers carry history between frames, so they start out cleared instead of being transient
+        auto clear_command_buffer = context->begin_single_time_commands();
+        for (auto &buffer : raytrace_pipeline->output_buffers) {
+            const VkClearColorValue       clear_color       = {{0.0f, 0.0f, 0.0f, 1.0f}};
+            const VkImageSubresourceRange subresource_range = {
+                .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel   = 0,
+                .levelCount     = 1,
+                .baseArrayLayer = 0,
+                .layerCount     = 1,
+            };
 
-    void on_update(float delta) override {
-        time += delta;
+            buffer->transition_layout(clear_command_buffer, VK_IMAGE_LAYOUT_GENERAL);
+            context->device_table().vkCmdClearColorImage(clear_command_buffer, buffer->handle(),
+                                                         VK_IMAGE_LAYOUT_GENERAL, &clear_color, 1,
+                                                         &subresource_range);
+        }
+        context->end_single_time_commands(clear_command_buffer);
 
-        auto command_buffer = Application::get().acquire_command_buffer();
+        build_render_graph();
+    }
 
-        const VkCommandBufferBeginInfo command_buffer_begin_info = {
-            .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .pNext            = nullptr,
-            .flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-            .pInheritanceInfo = nullptr,
+    void build_render_graph() {
+        auto &window = Application::get().window();
+
+        const TextureCreateInfo target_info = {
+            .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        };
+        const auto target = [&target_info](VkFormat format) {
+            auto info   = target_info;
+            info.format = format;
+            return info;
         };
 
-        context->device_table().vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
-        pipeline_factory->begin_frame(command_buffer);
+        const uint32_t width     = window->width();
+        const uint32_t height    = window->height();
+        const uint32_t rt_width  = static_cast<uint32_t>(width * rt_scale);
+        const uint32_t rt_height = static_cast<uint32_t>(height * rt_scale);
+
+        render_graph = RenderGraph::create(context);
+
+        const auto albedo    = render_graph->import_texture(albedo_buffer);
+        const auto emissive  = render_graph->import_texture(emissive_buffer);
+        const auto noise     = render_graph->import_texture(noise_texture);
+        const auto radiance0 = render_graph->import_texture(raytrace_pipeline->output_buffers[0]);
+        const auto radiance1 = render_graph->import_texture(raytrace_pipeline->output_buffers[1]);
+
+        const auto voronoi_seed =
+            render_graph->create_texture("voronoi_seed", target(VK_FORMAT_R8G8B8A8_UNORM), width, height);
+        const auto voronoi = render_graph->create_texture("voronoi", target(VK_FORMAT_R8G8B8A8_UNORM), width, height);
+        const auto distance_field =
+            render_graph->create_texture("distance_field", target(VK_FORMAT_R8G8_UNORM), width, height);
+        const auto noise_seed = render_graph->create_texture("noise_seed", target(VK_FORMAT_R8_UNORM),
+                                                             noise_texture->width(), noise_texture->height());
+        const auto denoised =
+            render_graph->create_texture("denoised", target(VK_FORMAT_R16G16B16A16_SFLOAT), rt_width, rt_height);
+        const auto upscaled =
+            render_graph->create_texture("upscaled", target(VK_FORMAT_R16G16B16A16_SFLOAT), width, height);
+        const auto composite =
+            render_graph->create_texture("composite", target(VK_FORMAT_R8G8B8A8_UNORM), width, height);
+
+        render_graph->add_pass({
+            .name    = "voronoi_seed",
+            .images  = {{emissive, ImageAccess::COMPUTE_READ}, {voronoi_seed, ImageAccess::COMPUTE_WRITE}},
+            .execute =
+                [this, emissive, voronoi_seed](VkCommandBuffer command_buffer) {
+                    auto pipeline = voronoi_seed_pipeline;
+                    auto output   = render_graph->texture(voronoi_seed);
+
+                    pipeline->begin(context, command_buffer);
+                    pipeline->bind_texture(context, command_buffer, 0, render_graph->texture(emissive));
+                    pipeline->bind_texture(context, command_buffer, 1, output);
+
+                    context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
+                                                          dispatch_size(output->height()), 1);
+                    pipeline->end(context, command_buffer);
+                },
+        });
+
+        // One pass per jump flood step, each reads the result of the previous one and writes the other image
+        const auto pass_count = static_cast<int>(glm::ceil(glm::log2(glm::max((float)width, (float)height))));
+        for (int i = 0; i < pass_count; i++) {
+            const bool forward = i % 2 == 0;
+            render_graph->add_pass({
+                .name    = "voronoi",
+                .images  = {{forward ? voronoi_seed : voronoi, ImageAccess::COMPUTE_READ},
+                            {forward ? voronoi : voronoi_seed, ImageAccess::COMPUTE_WRITE}},
+                .execute =
+                    [this, voronoi_seed, voronoi, pass_count, i](VkCommandBuffer command_buffer) {
+                        auto pipeline = voronoi_pipeline;
+                        auto output   = render_graph->texture(voronoi_seed);
+
+                        // The steps run back to back, so the pipeline and set bound by the first one stay bound
+                        if (i == 0) {
+                            pipeline->begin(context, command_buffer);
+                            pipeline->bind_texture(context, command_buffer, 0, output);
+                            pipeline->bind_texture(context, command_buffer, 1, render_graph->texture(voronoi));
+                        }
+
+                        float offset = glm::pow(2, pass_count - i - 1);
+                        struct {
+                            glm::vec2 inverse_resolution;
+                            glm::vec2 offset;
+                            glm::vec2 misc;
+                        } push_constants = {
+                            .inverse_resolution = {1.0f / output->width(), 1.0f / output->height()},
+                            .offset             = {offset, offset},
+                            .misc               = {i % 2 == 0, 0.0f},
+                        };
+
+                        pipeline->set_push_constants(context, command_buffer, sizeof(push_constants),
+                                                     &push_constants);
+                        context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
+                                                              dispatch_size(output->height()), 1);
+                        pipeline->end(context, command_buffer);
+                    },
+            });
+        }
+
+        render_graph->add_pass({
+            .name    = "distance_field",
+            .images  = {{voronoi, ImageAccess::COMPUTE_READ}, {distance_field, ImageAccess::COMPUTE_WRITE}},
+            .execute =
+                [this, voronoi, distance_field](VkCommandBuffer command_buffer) {
+                    auto pipeline = distance_field_pipeline;
+                    auto output   = render_graph->texture(distance_field);
+
+                    pipeline->begin(context, command_buffer);
+                    pipeline->bind_texture(context, command_buffer, 0, render_graph->texture(voronoi));
+                    pipeline->bind_texture(context, command_buffer, 1, output);
+
+                    context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
+                                                          dispatch_size(output->height()), 1);
+                    pipeline->end(context, command_buffer);
+                },
+        });
+
+        render_graph->add_pass({
+            .name    = "noise_seed",
+            .images  = {{noise, ImageAccess::COMPUTE_READ}, {noise_seed, ImageAccess::COMPUTE_WRITE}},
+            .execute =
+                [this, noise, noise_seed](VkCommandBuffer command_buffer) {
+                    auto pipeline = noise_seed_pipeline;
+                    auto output   = render_graph->texture(noise_seed);
+
+                    pipeline->begin(context, command_buffer);
+                    pipeline->bind_texture(context, command_buffer, 0, render_graph->texture(noise));
+                    pipeline->bind_texture(context, command_buffer, 1, output);
+
+                    struct {
+                        float time;
+                    } push_constants = {
+                        .time = time,
+                    };
+
+                    pipeline->set_push_constants(context, command_buffer, sizeof(push_constants), &push_constants);
+                    context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
+                                                          dispatch_size(output->height()), 1);
+                    pipeline->end(context, command_buffer);
+                },
+        });
+
+        // Both radiance buffers are declared every frame, which one holds the history alternates
+        render_graph->add_pass({
+            .name    = "raytrace",
+            .images  = {{distance_field, ImageAccess::COMPUTE_READ},
+                        {emissive, ImageAccess::COMPUTE_READ},
+                        {albedo, ImageAccess::COMPUTE_READ},
+                        {noise_seed, ImageAccess::COMPUTE_READ},
+                        {radiance0, ImageAccess::COMPUTE_READ_WRITE},
+                        {radiance1, ImageAccess::COMPUTE_READ_WRITE}},
+            .execute =
+                [this, distance_field, emissive, albedo, noise_seed](VkCommandBuffer command_buffer) {
+                    auto pipeline       = raytrace_pipeline;
+                    auto output         = pipeline->output_buffers[0];
+                    auto history_output = pipeline->output_buffers[1];
+                    if (frame_index != 0 && frame_index % 2 == 0) {
+                        history_output = pipeline->output_buffers[0];
+                        output         = pipeline->output_buffers[1];
+                    }
 
-        albedo_buffer->transition_layout(command_buffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-        emissive_buffer->transition_layout(command_buffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+                    pipeline->begin(context, command_buffer, sizeof(raytrace_pass_constants),
+                                    &raytrace_pass_constants);
+                    pipeline->bind_texture(context, command_buffer, 0, render_graph->texture(distance_field));
+                    pipeline->bind_texture(context, command_buffer, 1, render_graph->texture(emissive));
+                    pipeline->bind_texture(context, command_buffer, 2, render_graph->texture(albedo));
+                    pipeline->bind_texture(context, command_buffer, 3, render_graph->texture(noise_seed));
+                    pipeline->bind_texture(context, command_buffer, 4, history_output);
+                    pipeline->bind_texture(context, command_buffer, 5, output);
+
+                    raytrace_pass_constants.inverse_resolution = {1.0f / output->width(), 1.0f / output->height()};
+                    raytrace_pass_constants.resolution         = {output->width(), output->height()};
+                    raytrace_pass_constants.time               = time;
+                    raytrace_pass_constants.scale_modifier     = rt_scale;
+
+                    context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
+                                                          dispatch_size(output->height()), 1);
+                    pipeline->end(context, command_buffer);
+                },
+        });
+
+        render_graph->add_pass({
+            .name    = "rt_upscale",
+            .images  = {{radiance0, ImageAccess::COMPUTE_READ}, {denoised, ImageAccess::COMPUTE_WRITE}},
+            .execute =
+                [this, radiance0, denoised](VkCommandBuffer command_buffer) {
+                    auto pipeline = rt_upscale_pipeline;
+                    auto output   = render_graph->texture(denoised);
+
+                    pipeline->begin(context, command_buffer);
+                    pipeline->bind_texture(context, command_buffer, 0, render_graph->texture(radiance0));
+                    pipeline->bind_texture(context, command_buffer, 1, output);
+
+                    pipeline->set_push_constants(context, command_buffer, sizeof(rt_upscale_pass_constants),
+                                                 &rt_upscale_pass_constants);
+                    context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
+                                                          dispatch_size(output->height()), 1);
+                    pipeline->end(context, command_buffer);
+                },
+        });
+
+        render_graph->add_pass({
+            .name    = "rt_upscale_blit",
+            .images  = {{denoised, ImageAccess::TRANSFER_READ}, {upscaled, ImageAccess::TRANSFER_WRITE}},
+            .execute =
+                [this, denoised, upscaled](VkCommandBuffer command_buffer) {
+                    render_graph->texture(upscaled)->blit_from(render_graph->texture(denoised), command_buffer);
+                },
+        });
+
+        render_graph->add_pass({
+            .name    = "composite",
+            .images  = {{albedo, ImageAccess::COMPUTE_READ},
+                        {emissive, ImageAccess::COMPUTE_READ},
+                        {upscaled, ImageAccess::COMPUTE_READ},
+                        {composite, ImageAccess::COMPUTE_WRITE}},
+            .execute =
+                [this, albedo, emissive, upscaled, composite](VkCommandBuffer command_buffer) {
+                    auto pipeline = composite_pipeline;
+                    auto output   = render_graph->texture(composite);
+
+                    pipeline->begin(context, command_buffer, sizeof(composite_pass_constants),
+                                    &composite_pass_constants);
+                    pipeline->bind_texture(context, command_buffer, 0, render_graph->texture(albedo));
+                    pipeline->bind_texture(context, command_buffer, 1, render_graph->texture(emissive));
+                    pipeline->bind_texture(context, command_buffer, 2, render_graph->texture(upscaled));
+                    pipeline->bind_texture(context, command_buffer, 3, output);
+
+                    context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
+                                                          dispatch_size(output->height()), 1);
+                    pipeline->end(context, command_buffer);
+                },
+        });
+
+        render_graph->add_pass({
+            .name        = "present",
+            .images      = {{composite, ImageAccess::TRANSFER_READ}},
+            .side_effect = true,
+            .execute =
+                [this, composite](VkCommandBuffer command_buffer) {
+                    auto output = render_graph->texture(composite);
+                    Application::get().swapchain()->blit_to_current_image(
+                        command_buffer, output->handle(), {.width = output->width(), .height = output->height()});
+                },
+        });
+
+        render_graph->compile();
+    }
 
+    // Runs on a worker thread while on_update() records the compute passes
+    void record_sprites(VkCommandBuffer command_buffer) {
         float     half_width  = albedo_buffer->width() * 0.5f;
         float     half_height = albedo_buffer->height() * 0.5f;
         glm::mat4 mat         = glm::ortho(-half_width, half_width, -half_height, half_height, -1.0f, 1.0f);
@@ -247,203 +497,43 @@ public:
         sprite_batch->render(command_buffer);
 
         context->device_table().vkCmdEndRendering(command_buffer);
+    }
 
-        {
-            auto pipeline = voronoi_seed_pipeline;
-            auto output   = pipeline->output_buffers[0];
-
-            pipeline->begin(context, command_buffer);
-            emissive_buffer->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-
-            pipeline->bind_texture(context, command_buffer, 0, emissive_buffer);
-            pipeline->bind_texture(context, command_buffer, 1, output);
-
-            context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
-                                                  dispatch_size(output->height()), 1);
-            pipeline->end(context, command_buffer);
-        }
-
-        std::shared_ptr<Texture> voronoi_output_buffer = nullptr;
-        {
-            auto pipeline = voronoi_pipeline;
-            auto output   = voronoi_seed_pipeline->output_buffers[0];
-            auto output2  = pipeline->output_buffers[0];
-
-            auto pass_count = glm::ceil(glm::log2(glm::max((float)output->width(), (float)output->height())));
-
-            pipeline->begin(context, command_buffer);
-            output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            output2->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-
-            pipeline->bind_texture(context, command_buffer, 0, output);
-            pipeline->bind_texture(context, command_buffer, 1, output2);
-
-            for (int i = 0; i < pass_count; i++) {
-                float offset          = glm::pow(2, pass_count - i - 1);
-                voronoi_output_buffer = i % 2 == 0 ? output : output2;
-                struct {
-                    glm::vec2 inverse_resolution;
-                    glm::vec2 offset;
-                    glm::vec2 misc;
-                } push_constants = {
-                    .inverse_resolution = {1.0f / output->width(), 1.0f / output->height()},
-                    .offset             = {offset, offset},
-                    .misc               = {i % 2 == 0, 0.0f},
-                };
-
-                pipeline->set_push_constants(context, command_buffer, sizeof(push_constants), &push_constants);
-                context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
-                                                      dispatch_size(output->height()), 1);
-
-                output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-                output2->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            }
-            pipeline->end(context, command_buffer);
-        }
-
-        {
-            auto pipeline        = distance_field_pipeline;
-            auto output          = pipeline->output_buffers[0];
-            auto distance_buffer = voronoi_pipeline->output_buffers[0];
-
-            pipeline->begin(context, command_buffer);
-            output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            distance_buffer->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-
-            pipeline->bind_texture(context, command_buffer, 0, distance_buffer);
-            pipeline->bind_texture(context, command_buffer, 1, output);
-
-            context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
-                                                  dispatch_size(output->height()), 1);
-            pipeline->end(context, command_buffer);
-        }
-
-        {
-            auto pipeline = noise_seed_pipeline;
-            auto output   = pipeline->output_buffers[0];
-
-            pipeline->begin(context, command_buffer);
-            output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            noise_texture->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-
-            pipeline->bind_texture(context, command_buffer, 0, noise_texture);
-            pipeline->bind_texture(context, command_buffer, 1, output);
-
-            struct {
-                float time;
-            } push_constants = {
-                .time = time,
-            };
-
-            pipeline->set_push_constants(context, command_buffer, sizeof(push_constants), &push_constants);
-            context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
-                                                  dispatch_size(output->height()), 1);
-            pipeline->end(context, command_buffer);
-        }
+    void on_update(float delta) override {
+        time += delta;
 
-        {
-            auto pipeline       = raytrace_pipeline;
-            auto output         = pipeline->output_buffers[0];
-            auto history_output = pipeline->output_buffers[1];
-            auto df_pass_buffer = distance_field_pipeline->output_buffers[0];
-            auto noise          = noise_seed_pipeline->output_buffers[0];
-
-            pipeline->begin(context, command_buffer, sizeof(raytrace_pass_constants), &raytrace_pass_constants);
-            df_pass_buffer->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            emissive_buffer->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            noise->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            history_output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            albedo_buffer->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-
-            if (frame_index == 0) {
-                const VkClearColorValue       clear_color       = {{0.0f, 0.0f, 0.0f, 1.0f}};
-                const VkImageSubresourceRange subresource_range = {
-                    .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .baseMipLevel   = 0,
-                    .levelCount     = 1,
-                    .baseArrayLayer = 0,
-                    .layerCount     = 1,
-                };
-                context->device_table().vkCmdClearColorImage(command_buffer, history_output->handle(),
-                                                             VK_IMAGE_LAYOUT_GENERAL, &clear_color, 1,
-                                                             &subresource_range);
-            } else {
-                if (frame_index % 2 == 0) {
-                    history_output = raytrace_pipeline->output_buffers[0];
-                    output         = raytrace_pipeline->output_buffers[1];
-                } else {
-                    history_output = raytrace_pipeline->output_buffers[1];
-                    output         = raytrace_pipeline->output_buffers[0];
-                }
-            };
+        auto command_buffer = Application::get().acquire_command_buffer();
 
-            pipeline->bind_texture(context, command_buffer, 0, df_pass_buffer);
-            pipeline->bind_texture(context, command_buffer, 1, emissive_buffer);
-            pipeline->bind_texture(context, command_buffer, 2, albedo_buffer);
-            pipeline->bind_texture(context, command_buffer, 3, noise);
-            pipeline->bind_texture(context, command_buffer, 4, history_output);
-            pipeline->bind_texture(context, command_buffer, 5, output);
-
-            raytrace_pass_constants.inverse_resolution = {1.0f / output->width(), 1.0f / output->height()};
-            raytrace_pass_constants.resolution         = {output->width(), output->height()};
-            raytrace_pass_constants.time               = time;
-            raytrace_pass_constants.scale_modifier     = rt_scale;
-
-            context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
-                                                  dispatch_size(output->height()), 1);
-            pipeline->end(context, command_buffer);
-        }
+        const VkCommandBufferBeginInfo command_buffer_begin_info = {
+            .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext            = nullptr,
+            .flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = nullptr,
+        };
 
-        {
-            auto pipeline        = rt_upscale_pipeline;
-            auto rt_output       = raytrace_pipeline->output_buffers[0];
-            auto denoised_output = pipeline->output_buffers[0];
-            auto upscaled_output = pipeline->output_buffers[1];
+        context->device_table().vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+        pipeline_factory->begin_frame(command_buffer);
 
-            pipeline->begin(context, command_buffer);
-            denoised_output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            rt_output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
+        // Layouts are tracked on the textures, so transitions stay on this thread and the worker only draws
+        BarrierBatch barriers;
+        albedo_buffer->transition_layout(barriers, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        emissive_buffer->transition_layout(barriers, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        barriers.flush(*context, command_buffer);
+        context->device_table().vkEndCommandBuffer(command_buffer);
 
-            pipeline->bind_texture(context, command_buffer, 0, rt_output);
-            pipeline->bind_texture(context, command_buffer, 1, denoised_output);
+        sprite_batch_stats.sprite_count  = sprite_batch->sprite_count();
+        sprite_batch_stats.batch_count   = sprite_batch->batch_count();
+        sprite_batch_stats.texture_count = context->descriptor_heap().texture_count();
+        sprite_batch_stats.page_count    = sprite_batch->page_count();
 
-            pipeline->set_push_constants(context, command_buffer, sizeof(rt_upscale_pass_constants),
-                                         &rt_upscale_pass_constants);
-            context->device_table().vkCmdDispatch(command_buffer, dispatch_size(denoised_output->width()),
-                                                  dispatch_size(denoised_output->height()), 1);
-            pipeline->end(context, command_buffer);
+        Application::get().record_command_buffer([this](VkCommandBuffer command_buffer) {
+            record_sprites(command_buffer);
+        });
 
-            denoised_output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-            upscaled_output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-            upscaled_output->blit_from(denoised_output, command_buffer);
-        }
+        command_buffer = Application::get().acquire_command_buffer();
+        context->device_table().vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
 
-        {
-            auto pipeline  = composite_pipeline;
-            auto rt_output = rt_upscale_pipeline->output_buffers[1];
-            auto output    = pipeline->output_buffers[0];
-
-            pipeline->begin(context, command_buffer, sizeof(composite_pass_constants), &composite_pass_constants);
-            output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            albedo_buffer->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            rt_output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-            emissive_buffer->transition_layout(command_buffer, VK_IMAGE_LAYOUT_GENERAL);
-
-            pipeline->bind_texture(context, command_buffer, 0, albedo_buffer);
-            pipeline->bind_texture(context, command_buffer, 1, emissive_buffer);
-            pipeline->bind_texture(context, command_buffer, 2, rt_output);
-            pipeline->bind_texture(context, command_buffer, 3, output);
-
-            context->device_table().vkCmdDispatch(command_buffer, dispatch_size(output->width()),
-                                                  dispatch_size(output->height()), 1);
-            pipeline->end(context, command_buffer);
-
-            output->transition_layout(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-            Application::get().swapchain()->blit_to_current_image(
-                command_buffer, output->handle(), {.width = output->width(), .height = output->height()});
-        }
+        render_graph->execute(command_buffer);
 
         pipeline_factory->end_frame(command_buffer);
         context->device_table().vkEndCommandBuffer(command_buffer);
@@ -455,10 +545,32 @@ public:
                 ImGui::Text("Delta time: %.3f ms", delta);
                 ImGui::Text("FPS: %d", Application::get().frames_per_second());
 
+                const char *present_modes[] = {"FIFO", "Mailbox", "Immediate"};
+                if (ImGui::Combo("Present mode", &present_mode, present_modes, IM_ARRAYSIZE(present_modes))) {
+                    Application::get().set_present_mode(static_cast<PresentMode>(present_mode));
+                }
+
+                bool low_latency = Application::get().low_latency();
+                if (ImGui::Checkbox("Low latency", &low_latency)) {
+                    Application::get().set_low_latency(low_latency);
+                }
+
                 ImGui::SeparatorText("Sprite Batch stats");
-                ImGui::Text("Sprites: %d", sprite_batch->sprite_count());
-                ImGui::Text("Batches: %d", sprite_batch->batch_count());
-                ImGui::Text("Unique Textures: %d", sprite_batch->texture_count());
+                ImGui::Text("Sprites: %d", sprite_batch_stats.sprite_count);
+                ImGui::Text("Batches: %d", sprite_batch_stats.batch_count);
+                ImGui::Text("Instance pages: %d", sprite_batch_stats.page_count);
+                ImGui::Text("Bindless textures: %d", sprite_batch_stats.texture_count);
+
+                ImGui::SeparatorText("Descriptor heap");
+                ImGui::Text("Storage images: %d", context->descriptor_heap().storage_image_count());
+                ImGui::Text("Buffers: %d", context->descriptor_heap().buffer_count());
+
+                ImGui::SeparatorText("Render graph");
+                ImGui::Text("Passes: %d (%d culled)", render_graph->pass_count(), render_graph->culled_pass_count());
+                ImGui::Text("Barriers: %d", render_graph->barrier_count());
+                ImGui::Text("Transient memory: %.1f MiB (%.1f MiB unaliased)",
+                            render_graph->transient_memory() / (1024.0f * 1024.0f),
+                            render_graph->transient_memory_without_aliasing() / (1024.0f * 1024.0f));
                 if (ImGui::CollapsingHeader("Render Timings")) {
                     float total_time = pipeline_factory->pre_execution_time();
                     ImGui::Text("scene: %.3f ms", pipeline_factory->pre_execution_time());
@@ -526,6 +638,12 @@ public:
         : Application(argc, argv, window_info) {
         auto bindir = std::filesystem::path(argv[0]).parent_path();
 
+#ifdef NDEBUG
+        AssetStore::add_archive((bindir / "data" / "graphics_playground.pak").lexically_normal());
+#else
+        // Development builds load loose files so they can be edited while running
+        AssetStore::enable_hot_reload();
+#endif
         AssetStore::add_search_path((bindir / "data").lexically_normal());
         AssetStore::add_search_path(ASSET_DIR);
 
@@ -0,0 +1,150 @@
+// Bundles asset directories into a single archive, see milg/core/archive_format.hpp for the layout
+//
+// Usage: asset_packer <output.pak> <directory>...
+//
+// Each directory is stored under its own name, so packing data/maps yields entries like maps/level.json. Later
+// directories override entries of earlier ones with the same path
+
+#include <milg/core/archive_format.hpp>
+
+#include <lz4.h>
+#include <lz4hc.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Entry {
+        milg::ArchiveEntry header = {};
+        std::vector<char>  data   = {};
+        std::string        path   = {};
+    };
+
+    bool read_file(const std::filesystem::path &path, std::vector<char> &data) {
+        std::ifstream stream(path, std::ios::binary | std::ios::in | std::ios::ate);
+        if (!stream.is_open()) {
+            return false;
+        }
+
+        data.resize(static_cast<size_t>(stream.tellg()));
+        stream.seekg(0, std::ios::beg);
+        stream.read(data.data(), static_cast<std::streamsize>(data.size()));
+
+        return stream.good() || stream.eof();
+    }
+
+    // Only keeps the compressed data if it saves at least an eighth, already compressed formats are stored as is so
+    // they can be read straight out of the mapping
+    void compress(Entry &entry) {
+        const int         source_size = static_cast<int>(entry.data.size());
+        std::vector<char> compressed(static_cast<size_t>(LZ4_compressBound(source_size)));
+
+        const int size = LZ4_compress_HC(entry.data.data(), compressed.data(), source_size,
+                                         static_cast<int>(compressed.size()), LZ4HC_CLEVEL_MAX);
+        if (size <= 0 || static_cast<size_t>(size) > entry.data.size() - entry.data.size() / 8) {
+            return;
+        }
+
+        compressed.resize(static_cast<size_t>(size));
+        entry.data               = std::move(compressed);
+        entry.header.compression = milg::ArchiveCompression::LZ4;
+    }
+
+    uint64_t align(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <output.pak> <directory>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, std::filesystem::path> files;
+    for (int i = 2; i < argc; i++) {
+        const auto directory = std::filesystem::path(argv[i]).lexically_normal();
+        if (!std::filesystem::is_directory(directory)) {
+            std::cerr << "Skipping " << directory.string() << ", not a directory" << std::endl;
+            continue;
+        }
+
+        for (const auto &file : std::filesystem::recursive_directory_iterator(directory)) {
+            if (!file.is_regular_file()) {
+                continue;
+            }
+
+            const auto key = file.path().lexically_relative(directory.parent_path()).generic_string();
+            files[key]     = file.path();
+        }
+    }
+
+    std::vector<Entry> entries;
+    for (const auto &[key, path] : files) {
+        Entry entry = {};
+        if (!read_file(path, entry.data)) {
+            std::cerr << "Failed to read " << path.string() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        entry.path                     = key;
+        entry.header.hash              = milg::hash_asset_path(key);
+        entry.header.uncompressed_size = entry.data.size();
+        compress(entry);
+        entry.header.size = entry.data.size();
+
+        entries.push_back(std::move(entry));
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.header.hash != b.header.hash ? a.header.hash < b.header.hash : a.path < b.path;
+    });
+
+    // Lay out the entry data after the header, followed by the index and the path strings
+    uint64_t offset      = sizeof(milg::ArchiveHeader);
+    uint64_t path_offset = 0;
+    for (auto &entry : entries) {
+        offset                   = align(offset, milg::ARCHIVE_ALIGNMENT);
+        entry.header.offset      = offset;
+        entry.header.path_offset = path_offset;
+        entry.header.path_length = static_cast<uint32_t>(entry.path.size());
+
+        offset += entry.header.size;
+        path_offset += entry.path.size();
+    }
+
+    milg::ArchiveHeader header = {};
+    memcpy(header.magic, milg::ARCHIVE_MAGIC, sizeof(header.magic));
+    header.version      = milg::ARCHIVE_VERSION;
+    header.entry_count  = static_cast<uint32_t>(entries.size());
+    header.index_offset = align(offset, milg::ARCHIVE_ALIGNMENT);
+    header.paths_offset = header.index_offset + entries.size() * sizeof(milg::ArchiveEntry);
+
+    std::vector<char> archive(header.paths_offset + path_offset);
+    memcpy(archive.data(), &header, sizeof(header));
+    for (size_t i = 0; i < entries.size(); i++) {
+        const auto &entry = entries[i];
+
+        memcpy(archive.data() + entry.header.offset, entry.data.data(), entry.data.size());
+        memcpy(archive.data() + header.index_offset + i * sizeof(milg::ArchiveEntry), &entry.header,
+               sizeof(milg::ArchiveEntry));
+        memcpy(archive.data() + header.paths_offset + entry.header.path_offset, entry.path.data(), entry.path.size());
+    }
+
+    std::ofstream stream(argv[1], std::ios::binary | std::ios::out);
+    if (!stream.is_open()) {
+        std::cerr << "Failed to open " << argv[1] << " for writing" << std::endl;
+        return EXIT_FAILURE;
+    }
+    stream.write(archive.data(), static_cast<std::streamsize>(archive.size()));
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+// Converts an image into a KTX2 container with a full mip chain of BC1 (opaque) or BC3 (with alpha) blocks, so the
+// engine can upload it without decoding at runtime
+//
+// Usage: texture_compiler <input> <output.ktx2>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+    const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+    const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+    const uint32_t VK_FORMAT_BC3_UNORM_BLOCK     = 137;
+
+    const uint32_t KHR_DF_MODEL_BC1A              = 128;
+    const uint32_t KHR_DF_MODEL_BC3               = 130;
+    const uint32_t KHR_DF_PRIMARIES_BT709         = 1;
+    const uint32_t KHR_DF_TRANSFER_LINEAR         = 1;
+    const uint32_t KHR_DF_CHANNEL_BC1A_COLOR      = 0;
+    const uint32_t KHR_DF_CHANNEL_BC3_COLOR       = 0;
+    const uint32_t KHR_DF_CHANNEL_BC3_ALPHA       = 15;
+    const uint32_t KHR_DF_VERSION                 = 2;
+    const uint32_t KHR_DF_BASIC_BLOCK_HEADER_SIZE = 24;
+    const uint32_t KHR_DF_SAMPLE_SIZE             = 16;
+
+    const size_t HEADER_SIZE      = 80;
+    const size_t LEVEL_INDEX_SIZE = 24;
+
+    struct Image {
+        uint32_t             width  = 0;
+        uint32_t             height = 0;
+        std::vector<uint8_t> pixels = {};
+    };
+
+    Image downsample(const Image &src) {
+        Image dst = {
+            .width  = std::max(src.width / 2, 1u),
+            .height = std::max(src.height / 2, 1u),
+        };
+        dst.pixels.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+
+        for (uint32_t y = 0; y < dst.height; y++) {
+            const uint32_t y0 = std::min(y * 2, src.height - 1);
+            const uint32_t y1 = std::min(y * 2 + 1, src.height - 1);
+
+            for (uint32_t x = 0; x < dst.width; x++) {
+                const uint32_t x0 = std::min(x * 2, src.width - 1);
+                const uint32_t x1 = std::min(x * 2 + 1, src.width - 1);
+
+                for (uint32_t c = 0; c < 4; c++) {
+                    const uint32_t sum = src.pixels[(y0 * src.width + x0) * 4 + c] +
+                                         src.pixels[(y0 * src.width + x1) * 4 + c] +
+                                         src.pixels[(y1 * src.width + x0) * 4 + c] +
+                                         src.pixels[(y1 * src.width + x1) * 4 + c];
+
+                    dst.pixels[(y * dst.width + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+
+        return dst;
+    }
+
+    std::vector<uint8_t> compress(const Image &image, bool alpha) {
+        const uint32_t block_size  = alpha ? 16 : 8;
+        const uint32_t blocks_wide = (image.width + 3) / 4;
+        const uint32_t blocks_high = (image.height + 3) / 4;
+        const size_t   block_count = static_cast<size_t>(blocks_wide) * blocks_high;
+
+        auto    blocks            = std::vector<uint8_t>(block_count * block_size);
+        uint8_t texels[4 * 4 * 4] = {};
+
+        for (uint32_t by = 0; by < blocks_high; by++) {
+            for (uint32_t bx = 0; bx < blocks_wide; bx++) {
+                // Blocks hanging over the edge repeat the last row/column
+                for (uint32_t y = 0; y < 4; y++) {
+                    for (uint32_t x = 0; x < 4; x++) {
+                        const uint32_t sx = std::min(bx * 4 + x, image.width - 1);
+                        const uint32_t sy = std::min(by * 4 + y, image.height - 1);
+
+                        memcpy(&texels[(y * 4 + x) * 4], &image.pixels[(sy * image.width + sx) * 4], 4);
+                    }
+                }
+
+                stb_compress_dxt_block(&blocks[(by * blocks_wide + bx) * block_size], texels, alpha ? 1 : 0,
+                                       STB_DXT_HIGHQUAL);
+            }
+        }
+
+        return blocks;
+    }
+
+    void write_u32(std::vector<uint8_t> &out, size_t offset, uint32_t value) {
+        memcpy(&out[offset], &value, sizeof(value));
+    }
+
+    void write_u64(std::vector<uint8_t> &out, size_t offset, uint64_t value) {
+        memcpy(&out[offset], &value, sizeof(value));
+    }
+
+    std::vector<uint8_t> data_format_descriptor(bool alpha) {
+        const uint32_t sample_count = alpha ? 2 : 1;
+        const uint32_t block_size   = KHR_DF_BASIC_BLOCK_HEADER_SIZE + sample_count * KHR_DF_SAMPLE_SIZE;
+        auto           dfd          = std::vector<uint8_t>(4 + block_size);
+
+        write_u32(dfd, 0, static_cast<uint32_t>(dfd.size()));
+        write_u32(dfd, 4, 0);
+        write_u32(dfd, 8, KHR_DF_VERSION | (block_size << 16));
+        write_u32(dfd, 12,
+                  (alpha ? KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC1A) | (KHR_DF_PRIMARIES_BT709 << 8) |
+                      (KHR_DF_TRANSFER_LINEAR << 16));
+        write_u32(dfd, 16, 3 | (3 << 8));
+        write_u32(dfd, 20, alpha ? 16 : 8);
+        write_u32(dfd, 24, 0);
+
+        auto write_sample = [&](uint32_t index, uint32_t bit_offset, uint32_t channel) {
+            const size_t offset = 28 + index * KHR_DF_SAMPLE_SIZE;
+
+            write_u32(dfd, offset, bit_offset | (63 << 16) | (channel << 24));
+            write_u32(dfd, offset + 4, 0);
+            write_u32(dfd, offset + 8, 0);
+            write_u32(dfd, offset + 12, UINT32_MAX);
+        };
+
+        if (alpha) {
+            write_sample(0, 0, KHR_DF_CHANNEL_BC3_ALPHA);
+            write_sample(1, 64, KHR_DF_CHANNEL_BC3_COLOR);
+        } else {
+            write_sample(0, 0, KHR_DF_CHANNEL_BC1A_COLOR);
+        }
+
+        return dfd;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <input> <output.ktx2>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int32_t  width    = 0;
+    int32_t  height   = 0;
+    int32_t  channels = 0;
+    stbi_uc *data     = stbi_load(argv[1], &width, &height, &channels, STBI_rgb_alpha);
+    if (!data) {
+        std::cerr << "Failed to load " << argv[1] << ": " << stbi_failure_reason() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Image image = {
+        .width  = static_cast<uint32_t>(width),
+        .height = static_cast<uint32_t>(height),
+        .pixels = std::vector<uint8_t>(data, data + static_cast<size_t>(width) * height * 4),
+    };
+    stbi_image_free(data);
+
+    bool alpha = false;
+    for (size_t i = 3; i < image.pixels.size(); i += 4) {
+        if (image.pixels[i] != 255) {
+            alpha = true;
+            break;
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> levels;
+    while (true) {
+        levels.push_back(compress(image, alpha));
+        if (image.width == 1 && image.height == 1) {
+            break;
+        }
+        image = downsample(image);
+    }
+
+    const auto     dfd         = data_format_descriptor(alpha);
+    const uint32_t block_size  = alpha ? 16 : 8;
+    const uint32_t level_count = static_cast<uint32_t>(levels.size());
+    const size_t   dfd_offset  = HEADER_SIZE + LEVEL_INDEX_SIZE * level_count;
+
+    // Level data is stored smallest first, each level aligned to the block size
+    std::vector<size_t> level_offsets(level_count);
+    size_t              file_size = dfd_offset + dfd.size();
+    for (uint32_t i = level_count; i-- > 0;) {
+        file_size        = (file_size + block_size - 1) / block_size * block_size;
+        level_offsets[i] = file_size;
+        file_size += levels[i].size();
+    }
+
+    auto file = std::vector<uint8_t>(file_size);
+    memcpy(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    write_u32(file, 12, alpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+    write_u32(file, 16, 1);
+    write_u32(file, 20, static_cast<uint32_t>(width));
+    write_u32(file, 24, static_cast<uint32_t>(height));
+    write_u32(file, 28, 0);
+    write_u32(file, 32, 0);
+    write_u32(file, 36, 1);
+    write_u32(file, 40, level_count);
+    write_u32(file, 44, 0);
+    write_u32(file, 48, static_cast<uint32_t>(dfd_offset));
+    write_u32(file, 52, static_cast<uint32_t>(dfd.size()));
+    write_u32(file, 56, 0);
+    write_u32(file, 60, 0);
+    write_u64(file, 64, 0);
+    write_u64(file, 72, 0);
+
+    for (uint32_t i = 0; i < level_count; i++) {
+        const size_t offset = HEADER_SIZE + LEVEL_INDEX_SIZE * i;
+
+        write_u64(file, offset, level_offsets[i]);
+        write_u64(file, offset + 8, levels[i].size());
+        write_u64(file, offset + 16, levels[i].size());
+        memcpy(&file[level_offsets[i]], levels[i].data(), levels[i].size());
+    }
+    memcpy(&file[dfd_offset], dfd.data(), dfd.size());
+
+    std::ofstream stream(argv[2], std::ios::binary | std::ios::out);
+    if (!stream.is_open()) {
+        std::cerr << "Failed to open " << argv[2] << " for writing" << std::endl;
+        return EXIT_FAILURE;
+    }
+    stream.write(reinterpret_cast<const char *>(file.data()), static_cast<std::streamsize>(file.size()));
+
+    return EXIT_SUCCESS;
+}